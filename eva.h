@@ -12,8 +12,22 @@
 
 #define EVA_BUFFER_MAX_ATTRIBUTES   16
 #define EVA_SHADER_MAX_UNIFORMS     32
+#define EVA_SHADER_MAX_BLOCKS       16
 #define EVA_BINDINGS_MAX_VBOS       16
 #define EVA_BINDINGS_MAX_IMAGES     16
+#define EVA_BINDINGS_CACHE_SIZE     256
+#define EVA_BUFFER_STREAM_REGIONS   3
+#define EVA_CMDBUF_MAX_PASSES       256
+#define EVA_PASS_MAX_CMDBUFS        64
+#define EVA_IMAGE_STAGING_BUFFERS   8
+#define EVA_IMAGE_MAX_MIPMAPS       16
+#define EVA_IMAGE_RESIDENT_BUDGET   (512u * 1024u * 1024u)
+#define EVA_FRAMEBUFFER_MAX_COLORS  8
+#define EVA_POOL_MIN_BLOCK          16
+#define EVA_MAX_BUFFERS             4096
+#define EVA_MAX_SHADERS             256
+#define EVA_MAX_IMAGES              4096
+#define EVA_MAX_FRAMEBUFFERS        256
 
 enum {
     EVA_VERTEXFORMAT_INVALID,
@@ -21,12 +35,28 @@ enum {
     EVA_VERTEXFORMAT_FLOAT, EVA_VERTEXFORMAT_FLOAT2, EVA_VERTEXFORMAT_FLOAT3, EVA_VERTEXFORMAT_FLOAT4,
 };
 
+enum {
+    EVA_BUFFERTYPE_DEFAULT,
+    EVA_BUFFERTYPE_INDIRECT,
+};
+
+enum {
+    EVA_BUFFERUSAGE_DEFAULT,
+    EVA_BUFFERUSAGE_STREAM,
+};
+
+enum {
+    EVA_INDEXFORMAT_UINT32,
+    EVA_INDEXFORMAT_UINT16,
+};
+
 enum {
     EVA_UNIFORMFORMAT_INVALID,
     EVA_UNIFORMFORMAT_INT,    EVA_UNIFORMFORMAT_INT2,   EVA_UNIFORMFORMAT_INT3,   EVA_UNIFORMFORMAT_INT4,
     EVA_UNIFORMFORMAT_FLOAT,  EVA_UNIFORMFORMAT_FLOAT2, EVA_UNIFORMFORMAT_FLOAT3, EVA_UNIFORMFORMAT_FLOAT4,
     EVA_UNIFORMFORMAT_MAT3,   EVA_UNIFORMFORMAT_MAT4,
-    EVA_UNIFORMFORMAT_IMAGE2D
+    EVA_UNIFORMFORMAT_IMAGE2D,  // An int naming the texture unit, as bound by eva_bindings_desc_t.images
+    EVA_UNIFORMFORMAT_HANDLE,
 };
 
 enum {
@@ -37,6 +67,22 @@ enum {
 enum {
     EVA_IMAGEFORMAT_RGBA8,
     EVA_IMAGEFORMAT_RGB8,
+    EVA_IMAGEFORMAT_BC1,
+    EVA_IMAGEFORMAT_BC3,
+    EVA_IMAGEFORMAT_BC4,
+    EVA_IMAGEFORMAT_BC5,
+    EVA_IMAGEFORMAT_BC7,
+    EVA_IMAGEFORMAT_ETC2_RGB8,
+    EVA_IMAGEFORMAT_ETC2_RGBA8,
+    EVA_IMAGEFORMAT_RGBA16F,
+    EVA_IMAGEFORMAT_DEPTH,
+    EVA_IMAGEFORMAT_DEPTH_STENCIL,
+};
+
+enum {
+    EVA_IMAGETYPE_2D,
+    EVA_IMAGETYPE_ARRAY,
+    EVA_IMAGETYPE_3D,
 };
 
 enum {
@@ -46,6 +92,91 @@ enum {
     EVA_IMAGEWRAP_CLAMP_TO_BORDER,
 };
 
+enum {
+    EVA_LOADACTION_CLEAR,
+    EVA_LOADACTION_LOAD,
+    EVA_LOADACTION_DONTCARE,
+};
+
+enum {
+    EVA_STOREACTION_STORE,
+    EVA_STOREACTION_DISCARD,
+    EVA_STOREACTION_RESOLVE,
+};
+
+enum {
+    EVA_PRIMITIVETYPE_TRIANGLES,
+    EVA_PRIMITIVETYPE_TRIANGLE_STRIP,
+    EVA_PRIMITIVETYPE_LINES,
+    EVA_PRIMITIVETYPE_LINE_STRIP,
+    EVA_PRIMITIVETYPE_POINTS,
+};
+
+enum {
+    EVA_BLENDFACTOR_DEFAULT,
+    EVA_BLENDFACTOR_ZERO,
+    EVA_BLENDFACTOR_ONE,
+    EVA_BLENDFACTOR_SRC_COLOR,
+    EVA_BLENDFACTOR_ONE_MINUS_SRC_COLOR,
+    EVA_BLENDFACTOR_SRC_ALPHA,
+    EVA_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+    EVA_BLENDFACTOR_DST_COLOR,
+    EVA_BLENDFACTOR_ONE_MINUS_DST_COLOR,
+    EVA_BLENDFACTOR_DST_ALPHA,
+    EVA_BLENDFACTOR_ONE_MINUS_DST_ALPHA,
+};
+
+enum {
+    EVA_BLENDOP_ADD,
+    EVA_BLENDOP_SUBTRACT,
+    EVA_BLENDOP_REVERSE_SUBTRACT,
+    EVA_BLENDOP_MIN,
+    EVA_BLENDOP_MAX,
+};
+
+enum {
+    EVA_COLORMASK_DEFAULT = 0x00,
+    EVA_COLORMASK_R       = 0x01,
+    EVA_COLORMASK_G       = 0x02,
+    EVA_COLORMASK_B       = 0x04,
+    EVA_COLORMASK_A       = 0x08,
+    EVA_COLORMASK_RGBA    = 0x0F,
+    EVA_COLORMASK_NONE    = 0x10,
+};
+
+enum {
+    EVA_COMPAREFUNC_ALWAYS,
+    EVA_COMPAREFUNC_NEVER,
+    EVA_COMPAREFUNC_LESS,
+    EVA_COMPAREFUNC_LEQUAL,
+    EVA_COMPAREFUNC_EQUAL,
+    EVA_COMPAREFUNC_GEQUAL,
+    EVA_COMPAREFUNC_GREATER,
+    EVA_COMPAREFUNC_NOTEQUAL,
+};
+
+enum {
+    EVA_STENCILOP_KEEP,
+    EVA_STENCILOP_ZERO,
+    EVA_STENCILOP_REPLACE,
+    EVA_STENCILOP_INCR,
+    EVA_STENCILOP_DECR,
+    EVA_STENCILOP_INVERT,
+    EVA_STENCILOP_INCR_WRAP,
+    EVA_STENCILOP_DECR_WRAP,
+};
+
+enum {
+    EVA_CULLMODE_NONE,
+    EVA_CULLMODE_BACK,
+    EVA_CULLMODE_FRONT,
+};
+
+enum {
+    EVA_FACEWINDING_CCW,
+    EVA_FACEWINDING_CW,
+};
+
 enum {
     EVA_IMAGEFILTER_NEAREST,
     EVA_IMAGEFILTER_LINEAR,
@@ -58,16 +189,41 @@ enum {
 ///////////////////////////////////////////////////////////////////////////////
 /// Types
 
-typedef struct eva_buffer_t    eva_buffer_t;
-typedef struct eva_shader_t    eva_shader_t;
-typedef struct eva_image_t     eva_image_t;
+typedef struct eva_cmdbuf_t    eva_cmdbuf_t;
+typedef struct eva_pool_t      eva_pool_t;
+
+// Generation-checked references to resources, which stop resolving once the resource is deleted, so a stale one is
+// reported rather than reaching whatever was created in its place. An id of 0 never refers to anything.
+typedef struct eva_buffer_t      { unsigned int id; } eva_buffer_t;
+typedef struct eva_shader_t      { unsigned int id; } eva_shader_t;
+typedef struct eva_image_t       { unsigned int id; } eva_image_t;
+typedef struct eva_framebuffer_t { unsigned int id; } eva_framebuffer_t;
 
 typedef struct eva_buffer_desc_t {
     void const *data;
     size_t size;
+    int type;
+    int usage;
+    int divisor;
+    int index_format;
     int layout[EVA_BUFFER_MAX_ATTRIBUTES];
 } eva_buffer_desc_t;
 
+typedef struct eva_draw_arrays_indirect_t {
+    unsigned int count;
+    unsigned int instances;
+    unsigned int first;
+    unsigned int base_instance;
+} eva_draw_arrays_indirect_t;
+
+typedef struct eva_draw_elements_indirect_t {
+    unsigned int count;
+    unsigned int instances;
+    unsigned int first;
+    int base_vertex;
+    unsigned int base_instance;
+} eva_draw_elements_indirect_t;
+
 typedef struct eva_shader_desc_t {
     struct {
         char const *src;
@@ -76,53 +232,220 @@ typedef struct eva_shader_desc_t {
         char const *name;
         int format;
     } uniforms[EVA_SHADER_MAX_UNIFORMS];
+    struct {
+        char const *name;
+        int binding;                // Shaders naming the same binding share one buffer, so it must have one layout
+    } block;
+    char const *cache_dir;
+    int async;
 } eva_shader_desc_t;
 
 typedef struct eva_image_desc_t {
     void const *data;
+    int type;
     int width;
     int height;
+    int depth;
     int format;
     struct {
-        int s, t;
+        int s, t, r;
     } wrap;
     struct {
         int min, mag;
     } filter;
+    struct {
+        int count;
+        int generate;
+        void const *data[EVA_IMAGE_MAX_MIPMAPS];
+    } mipmaps;
+    int samples;
+    int render_only; // Multisampled images that are never sampled can live in a renderbuffer instead
+    int async;
 } eva_image_desc_t;
 
+typedef struct eva_attachment_desc_t {
+    eva_image_t image;
+    int level;
+    int layer;
+} eva_attachment_desc_t;
+
+typedef struct eva_framebuffer_desc_t {
+    eva_attachment_desc_t colors[EVA_FRAMEBUFFER_MAX_COLORS];
+    eva_attachment_desc_t depth;
+} eva_framebuffer_desc_t;
+
 typedef struct eva_bindings_desc_t {
-    eva_buffer_t *vbos[EVA_BINDINGS_MAX_VBOS];
-    eva_buffer_t *ibo;
-    eva_image_t  *images[EVA_BINDINGS_MAX_IMAGES];
+    eva_buffer_t vbos[EVA_BINDINGS_MAX_VBOS];
+    eva_buffer_t ibo;
+    eva_image_t  images[EVA_BINDINGS_MAX_IMAGES];
 } eva_bindings_desc_t;
 
+// A zeroed pipeline draws triangles with blending, depth, stencil and culling all disabled
 typedef struct eva_pipeline_desc_t {
-    eva_shader_t *shader;
+    eva_shader_t shader;
+    int primitive;
+    struct {
+        int enabled;
+        int src_rgb, dst_rgb, op_rgb;
+        int src_alpha, dst_alpha, op_alpha;
+        int color_mask;
+    } blend;
+    struct {
+        int compare;                        // Depth testing is enabled by any compare other than ALWAYS, or by writing
+        int write;
+    } depth;
+    struct {
+        int enabled;
+        struct {
+            int compare, fail, depth_fail, pass;
+        } front, back;
+        unsigned int read_mask;             // 0 means every bit
+        unsigned int write_mask;            // Every bit unless write_mask_set, so that 0 can mask all writes
+        int write_mask_set;
+        int ref;
+    } stencil;
+    struct {
+        int cull;
+        int front_face;
+        float offset_factor, offset_units;  // Polygon offset is enabled when either is nonzero
+    } rasterizer;
 } eva_pipeline_desc_t;
 
 typedef struct eva_pass_desc_t {
+    eva_framebuffer_t framebuffer;     // A zero id renders to the default framebuffer
     struct { float r, g, b, a; } clear;
     struct { int   x, y, w, h; } viewport;
+    struct {
+        int colors[EVA_FRAMEBUFFER_MAX_COLORS];
+        int depth;
+        int stencil;
+    } load;
+    struct {
+        int colors[EVA_FRAMEBUFFER_MAX_COLORS];
+        int depth;
+        int stencil;
+    } store;
+    eva_framebuffer_t resolve;
 } eva_pass_desc_t;
 
+typedef struct eva_pool_desc_t {
+    int vertices;
+    int indices;                    // 0 for a pool without an index buffer
+    int index_format;
+    int layout[EVA_BUFFER_MAX_ATTRIBUTES];
+} eva_pool_desc_t;
+
+typedef struct eva_mesh_desc_t {
+    void const *vertices;
+    int nvertices;
+    void const *indices;
+    int nindices;
+} eva_mesh_desc_t;
+
+// Arguments for eva_draw_base_vertex, which stay valid until the caller next runs eva_pool_compact
+typedef struct eva_mesh_t {
+    int first;
+    int count;
+    int base_vertex;
+} eva_mesh_t;
+
+typedef struct eva_cmdbuf_desc_t {
+    size_t arena_size;
+    int max_draws;
+} eva_cmdbuf_desc_t;
+
+typedef struct eva_setup_desc_t {
+    int max_buffers;                // 0 uses EVA_MAX_BUFFERS, and likewise for the others
+    int max_shaders;
+    int max_images;
+    int max_framebuffers;
+} eva_setup_desc_t;
+
+// Queried once by eva_setup, so fast paths are picked without asking GL again
+typedef struct eva_caps_t {
+    int max_texture_units;
+    int max_texture_size;
+    int max_samples;
+    int uniform_buffer_alignment;
+    int draw_indirect;
+    int multi_draw_indirect;
+    int program_binary;
+    int texture_storage;
+    int texture_storage_multisample;
+    int invalidate_framebuffer;
+    int persistent_mapping;
+    int dsa;
+    int bindless;
+    int parallel_compile;
+    int texture_s3tc;
+    int texture_bptc;
+    int texture_etc2;
+} eva_caps_t;
+
+typedef struct eva_stats_t {
+    unsigned long issued;
+    unsigned long skipped;
+} eva_stats_t;
+
 ///////////////////////////////////////////////////////////////////////////////
 /// Functions
 
-eva_buffer_t   *eva_buffer_create   (eva_buffer_desc_t *desc);
-eva_shader_t   *eva_shader_create   (eva_shader_desc_t *desc);
-eva_image_t    *eva_image_create    (eva_image_desc_t *desc);
+void            eva_setup           (eva_setup_desc_t *desc);
+eva_caps_t      eva_caps            (void);
+
+eva_buffer_t    eva_buffer_create   (eva_buffer_desc_t *desc);
+eva_shader_t    eva_shader_create   (eva_shader_desc_t *desc);
+eva_image_t     eva_image_create    (eva_image_desc_t *desc);
+eva_image_t     eva_image_load_file (char const *path, eva_image_desc_t *desc);
+eva_framebuffer_t eva_framebuffer_create(eva_framebuffer_desc_t *desc);
+
+int             eva_shader_ready    (eva_shader_t shader);
+void            eva_image_update    (eva_image_t image, int level, int layer, void const *data);
+int             eva_image_ready     (eva_image_t image);
+unsigned long long eva_image_handle (eva_image_t image);
+int             eva_image_format_supported(int format);
+
+size_t          eva_buffer_update   (eva_buffer_t buffer, void const *data, size_t size);
+size_t          eva_buffer_append   (eva_buffer_t buffer, void const *data, size_t size);
 
 void            eva_pass_begin      (eva_pass_desc_t *pass);
 void            eva_bindings_apply  (eva_bindings_desc_t *bindings);
 void            eva_pipeline_apply  (eva_pipeline_desc_t *pipeline);
 void            eva_uniforms_apply  (void *data);
 void            eva_draw            (int first, int count);
+void            eva_draw_instanced  (int first, int count, int instances);
+void            eva_draw_base_vertex(int first, int count, int instances, int base_vertex);
+void            eva_draw_indirect   (eva_buffer_t buffer, size_t offset, int count);
+void            eva_pass_submit     (eva_cmdbuf_t *cmdbuf);
 void            eva_pass_end        (void);
 
-void            eva_image_delete    (eva_image_t *image);
-void            eva_shader_delete   (eva_shader_t *shader);
-void            eva_buffer_delete   (eva_buffer_t *buffer);
+eva_cmdbuf_t   *eva_cmdbuf_create           (eva_cmdbuf_desc_t *desc);
+void            eva_cmdbuf_pass_begin       (eva_cmdbuf_t *cmdbuf, eva_pass_desc_t *pass);
+void            eva_cmdbuf_bindings         (eva_cmdbuf_t *cmdbuf, eva_bindings_desc_t *bindings);
+void            eva_cmdbuf_pipeline         (eva_cmdbuf_t *cmdbuf, eva_pipeline_desc_t *pipeline);
+void            eva_cmdbuf_uniforms         (eva_cmdbuf_t *cmdbuf, void const *data, size_t size);
+void            eva_cmdbuf_draw             (eva_cmdbuf_t *cmdbuf, int first, int count, float depth);
+void            eva_cmdbuf_draw_instanced   (eva_cmdbuf_t *cmdbuf, int first, int count, int instances, float depth);
+void            eva_cmdbuf_draw_base_vertex (eva_cmdbuf_t *cmdbuf, int first, int count, int instances, int base_vertex, float depth);
+void            eva_cmdbuf_submit           (eva_cmdbuf_t *cmdbuf);
+void            eva_cmdbuf_reset            (eva_cmdbuf_t *cmdbuf);
+void            eva_cmdbuf_delete           (eva_cmdbuf_t *cmdbuf);
+
+eva_pool_t     *eva_pool_create     (eva_pool_desc_t *desc);
+int             eva_pool_alloc      (eva_pool_t *pool, eva_mesh_desc_t *desc);
+eva_mesh_t      eva_pool_mesh       (eva_pool_t *pool, int mesh);
+void            eva_pool_free       (eva_pool_t *pool, int mesh);
+void            eva_pool_compact    (eva_pool_t *pool);
+void            eva_pool_bindings   (eva_pool_t *pool, eva_bindings_desc_t *bindings);
+
+eva_stats_t     eva_stats           (void);
+void            eva_stats_reset     (void);
+
+void            eva_image_delete    (eva_image_t image);
+void            eva_shader_delete   (eva_shader_t shader);
+void            eva_buffer_delete   (eva_buffer_t buffer);
+void            eva_framebuffer_delete(eva_framebuffer_t framebuffer);
+void            eva_pool_delete     (eva_pool_t *pool);
 
 ///////////////////////////////////////////////////////////////////////////////
 ///                                                                         ///
@@ -135,8 +458,30 @@ void            eva_buffer_delete   (eva_buffer_t *buffer);
 #define GLAD_GL_IMPLEMENTATION
 #include "glad.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT    0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT    0x83F3
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR  0x91B0
+#define GL_COMPLETION_STATUS_KHR            0x91B1
+
+typedef void (GLAD_API_PTR *_EVA_PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+typedef GLuint64 (GLAD_API_PTR *_EVA_PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (GLAD_API_PTR *_EVA_PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (GLAD_API_PTR *_EVA_PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+typedef void (GLAD_API_PTR *_EVA_PFNGLUNIFORMHANDLEUI64ARBPROC)(GLint location, GLuint64 value);
 
 ///////////////////////////////////////////////////////////////////////////////
 /// Types
@@ -148,34 +493,297 @@ typedef struct _eva_vertex_attr_desc_t {
     size_t offset;
 } _eva_vertex_attr_desc_t;
 
-struct eva_buffer_t {
+typedef struct _eva_buffer_t {
     _eva_vertex_attr_desc_t attributes[EVA_BUFFER_MAX_ATTRIBUTES];
     int nattributes;
     size_t stride;
+    struct {
+        unsigned char *mapped;
+        GLsync fences[EVA_BUFFER_STREAM_REGIONS];
+        size_t region_size;
+        size_t cursor;
+        int region;
+    } stream;
+    size_t size;
+    int type;
+    int usage;
+    int divisor;
+    unsigned int index_type;
+    size_t index_size;
     unsigned int id;
-};
+} _eva_buffer_t;
 
 typedef struct _eva_uniform_desc_t {
     int location;
     int format;
     size_t offset;
+    size_t block_offset;
 } _eva_uniform_desc_t;
 
-struct eva_shader_t {
+typedef struct _eva_shader_pending_t {
+    eva_shader_desc_t desc;
+    unsigned int stages[2];
+    unsigned long long hash;
+    char path[1024];
+    char strings[];
+} _eva_shader_pending_t;
+
+typedef struct _eva_shader_t {
+    _eva_shader_pending_t *pending;
     _eva_uniform_desc_t uniforms[EVA_SHADER_MAX_UNIFORMS];
     int nuniforms;
+    size_t uniforms_size;
+    struct {
+        int binding;
+        size_t size;
+    } block;
     unsigned int id;
-};
+} _eva_shader_t;
+
+typedef struct _eva_image_t {
+    GLsync upload;
+    unsigned long long handle;
+    unsigned long long last_used;
+    size_t bytes;
+    int resident;
+    unsigned int id;
+    unsigned int target;
+    int format;
+    int width;
+    int height;
+    int depth;
+    int mipmaps;
+    int samples;
+} _eva_image_t;
 
-struct eva_image_t {
+typedef struct _eva_framebuffer_t {
     unsigned int id;
+    int ncolors;
+    int depth;
+    int stencil;
+    int samples;
     int width;
     int height;
+} _eva_framebuffer_t;
+
+typedef struct _eva_file_map_t {
+    unsigned char const *data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} _eva_file_map_t;
+
+typedef struct _eva_block_t {
+    unsigned int id;
+    size_t size;
+    unsigned char *data;
+    int dirty;
+    int refs;
+} _eva_block_t;
+
+typedef struct _eva_staging_t {
+    GLsync fence;
+    size_t size;
+    unsigned int id;
+    unsigned long long serial;
+} _eva_staging_t;
+
+#define _EVA_CMD_NONE ((size_t)-1)
+
+typedef struct _eva_cmd_draw_t {
+    unsigned long long key;
+    size_t bindings;
+    size_t pipeline;
+    size_t uniforms;
+    size_t uniforms_size;
+    int first;
+    int count;
+    int instances;
+    int base_vertex;
+} _eva_cmd_draw_t;
+
+typedef struct _eva_cmd_sort_t {
+    unsigned long long key;
+    int index;
+    int source;
+} _eva_cmd_sort_t;
+
+struct eva_cmdbuf_t {
+    unsigned char *arena;
+    size_t arena_size;
+    size_t arena_used;
+    _eva_cmd_draw_t *draws;
+    _eva_cmd_sort_t *sort[2];
+    int ndraws;
+    int max_draws;
+    size_t passes[EVA_CMDBUF_MAX_PASSES];
+    int npasses;
+    size_t bindings;
+    size_t pipeline;
+    size_t uniforms;
+    size_t uniforms_size;
+};
+
+#define _EVA_SLOT_INDEX_BITS 20
+#define _EVA_SLOT_INDEX_MASK ((1u << _EVA_SLOT_INDEX_BITS) - 1)
+
+// Fixed arrays of resources; callers only ever see handles, so a deleted slot can be recognised after reuse
+typedef struct _eva_slots_t {
+    unsigned char *items;
+    unsigned short *generations;
+    int *free;
+    int nfree;
+    int count;
+    int capacity;
+    size_t size;
+    char const *name;
+} _eva_slots_t;
+
+#define _EVA_BUDDY_MAX_ORDERS 24
+
+// One free bitmap per block order, order k blocks being EVA_POOL_MIN_BLOCK << k elements
+typedef struct _eva_buddy_t {
+    unsigned long long *bits[_EVA_BUDDY_MAX_ORDERS];
+    int nfree[_EVA_BUDDY_MAX_ORDERS];
+    int orders;
+} _eva_buddy_t;
+
+typedef struct _eva_pool_mesh_t {
+    int vertex_offset;
+    int vertex_order;
+    int nvertices;
+    int index_offset;
+    int index_order;
+    int nindices;
+    int live;
+    int next;
+} _eva_pool_mesh_t;
+
+typedef struct _eva_pool_block_t {
+    int *offset;
+    int order;
+    int count;
+} _eva_pool_block_t;
+
+struct eva_pool_t {
+    eva_buffer_t vbo;
+    eva_buffer_t ibo;
+    _eva_buddy_t vertices;
+    _eva_buddy_t indices;
+    _eva_pool_mesh_t *meshes;
+    int nmeshes;
+    int capacity;
+    int free_mesh;
+};
+
+// Bindings with every handle resolved, as the VAO cache and draw calls use them
+typedef struct _eva_bindings_t {
+    _eva_buffer_t *vbos[EVA_BINDINGS_MAX_VBOS];
+    _eva_buffer_t *ibo;
+    _eva_image_t *images[EVA_BINDINGS_MAX_IMAGES];
+} _eva_bindings_t;
+
+typedef struct _eva_vao_t {
+    _eva_buffer_t *vbos[EVA_BINDINGS_MAX_VBOS];
+    _eva_buffer_t *ibo;
+    unsigned int hash;
+    unsigned int id;
+    int state;
+} _eva_vao_t;
+
+enum {
+    _EVA_VAOSTATE_EMPTY,
+    _EVA_VAOSTATE_USED,
+    _EVA_VAOSTATE_DELETED,
 };
 
+// The resolved pointers are cleared by the deletes, so draws never reach a freed or reused slot
 static struct {
-    eva_bindings_desc_t bindings;
+    _eva_bindings_t bindings;
     eva_pipeline_desc_t pipeline;
+    _eva_shader_t *shader;
+    struct {
+        _eva_vao_t entries[EVA_BINDINGS_CACHE_SIZE];
+        int count;
+    } vaos;
+    struct {
+        unsigned int program;
+        unsigned int framebuffer;
+        unsigned int vao;
+        unsigned int array_buffer;
+        unsigned int indirect_buffer;
+        unsigned int uniform_buffers[EVA_SHADER_MAX_BLOCKS];
+        unsigned int textures[EVA_BINDINGS_MAX_IMAGES];
+        int active_texture;
+        struct { int   x, y, w, h; } viewport;
+        struct { float r, g, b, a; } clear;
+        struct {
+            int enabled;
+            unsigned int src_rgb, dst_rgb, src_alpha, dst_alpha;
+            unsigned int op_rgb, op_alpha;
+            int color_mask;
+        } blend;
+        struct {
+            int enabled;
+            unsigned int func;
+            int write;
+        } depth;
+        struct {
+            int enabled;
+            struct {
+                unsigned int func, fail, depth_fail, pass;
+                unsigned int read_mask, write_mask;
+                int ref;
+            } faces[2];
+        } stencil;
+        struct {
+            int enabled;
+            unsigned int face;
+            unsigned int front_face;
+        } cull;
+        struct {
+            int enabled;
+            float factor, units;
+        } offset;
+    } state;
+    struct {
+        eva_cmdbuf_t *cmdbufs[EVA_PASS_MAX_CMDBUFS];
+        int count;
+        _eva_cmd_sort_t *sort[2];
+        int capacity;
+    } queue;
+    eva_pass_desc_t pass;
+    _eva_framebuffer_t *framebuffer;
+    _eva_framebuffer_t *resolve;
+    struct {
+        _eva_staging_t buffers[EVA_IMAGE_STAGING_BUFFERS];
+        int count;
+        unsigned long long serial;
+    } staging;
+    struct {
+        _eva_image_t **images;
+        int count;
+        int capacity;
+        _eva_image_t **table;        // Open addressed by handle, twice the capacity so probes stay short
+        size_t bytes;
+        unsigned long long epoch;
+    } resident;
+    struct {
+        _EVA_PFNGLGETTEXTUREHANDLEARBPROC get_handle;
+        _EVA_PFNGLMAKETEXTUREHANDLERESIDENTARBPROC make_resident;
+        _EVA_PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC make_non_resident;
+        _EVA_PFNGLUNIFORMHANDLEUI64ARBPROC uniform_handle;
+    } bindless;
+    _eva_slots_t buffers;
+    _eva_slots_t shaders;
+    _eva_slots_t images;
+    _eva_slots_t framebuffers;
+    _eva_block_t blocks[EVA_SHADER_MAX_BLOCKS];
+    eva_caps_t caps;
+    unsigned long long driver_hash;
+    eva_stats_t stats;
     unsigned int vao;
     int initted;
 } _eva = {0};
@@ -183,267 +791,3052 @@ static struct {
 ///////////////////////////////////////////////////////////////////////////////
 /// Functions
 
-static void _eva_init(void) {
-    gladLoaderLoadGL();
-    glGenVertexArrays(1, &_eva.vao);
-    glBindVertexArray(_eva.vao);
+static int _eva_state_changed(int changed) {
+    if (changed)
+        _eva.stats.issued++;
+    else
+        _eva.stats.skipped++;
+    return changed;
 }
 
-static _eva_vertex_attr_desc_t _eva_vertex_attr_translate(int format, size_t *size) {
-    switch (format) {
-        case EVA_VERTEXFORMAT_INT:    *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 1};
-        case EVA_VERTEXFORMAT_INT2:   *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 2};
-        case EVA_VERTEXFORMAT_INT3:   *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 3};
-        case EVA_VERTEXFORMAT_INT4:   *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 4};
-        case EVA_VERTEXFORMAT_FLOAT:  *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 1};
-        case EVA_VERTEXFORMAT_FLOAT2: *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 2};
-        case EVA_VERTEXFORMAT_FLOAT3: *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 3};
-        case EVA_VERTEXFORMAT_FLOAT4: *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 4};
+static void _eva_state_program(unsigned int id) {
+    if (_eva_state_changed(_eva.state.program != id)) {
+        glUseProgram(id);
+        _eva.state.program = id;
     }
-    *size = 0;
-    return (_eva_vertex_attr_desc_t){0};
 }
 
-static size_t _eva_uniform_format_size(int format) {
-    switch (format) {
-        case EVA_UNIFORMFORMAT_INT:     return  1 * sizeof(int);
-        case EVA_UNIFORMFORMAT_INT2:    return  2 * sizeof(int);
-        case EVA_UNIFORMFORMAT_INT3:    return  3 * sizeof(int);
-        case EVA_UNIFORMFORMAT_INT4:    return  4 * sizeof(int);
-        case EVA_UNIFORMFORMAT_FLOAT:   return  1 * sizeof(float);
-        case EVA_UNIFORMFORMAT_FLOAT2:  return  2 * sizeof(float);
-        case EVA_UNIFORMFORMAT_FLOAT3:  return  3 * sizeof(float);
-        case EVA_UNIFORMFORMAT_FLOAT4:  return  4 * sizeof(float);
-        case EVA_UNIFORMFORMAT_MAT3:    return 12 * sizeof(float);
-        case EVA_UNIFORMFORMAT_MAT4:    return 16 * sizeof(float);
-        case EVA_UNIFORMFORMAT_IMAGE2D: return  1 * sizeof(eva_image_t);
+static void _eva_state_framebuffer(unsigned int id) {
+    if (_eva_state_changed(_eva.state.framebuffer != id)) {
+        glBindFramebuffer(GL_FRAMEBUFFER, id);
+        _eva.state.framebuffer = id;
     }
-    return 0;
 }
 
-static unsigned int _eva_shader_stage_create(int stage, char const *src) {
-    unsigned int shader = glCreateShader(stage);
-    glShaderSource(shader, 1, &src, NULL);
-    glCompileShader(shader);
-
-    int success = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (success == 0) {
-        char log[512] = {0};
-        glGetShaderInfoLog(shader, sizeof log, NULL, log);
-        fprintf(stderr, "%s\n", log);
+static void _eva_state_vao(unsigned int id) {
+    if (_eva_state_changed(_eva.state.vao != id)) {
+        glBindVertexArray(id);
+        _eva.state.vao = id;
     }
-
-    return shader;
 }
 
-static int TranslateImageFormat(int format) {
-    switch (format) {
-        case EVA_IMAGEFORMAT_RGBA8: return GL_RGBA8;
-        case EVA_IMAGEFORMAT_RGB8:  return GL_RGB8;
+static void _eva_state_array_buffer(unsigned int id) {
+    if (_eva_state_changed(_eva.state.array_buffer != id)) {
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        _eva.state.array_buffer = id;
     }
-    return 0;
 }
 
-static int TranslateImageWrap(int wrap) {
-    switch (wrap) {
-        case EVA_IMAGEWRAP_REPEAT:          return GL_REPEAT;
-        case EVA_IMAGEWRAP_MIRRORED_REPEAT: return GL_MIRRORED_REPEAT;
-        case EVA_IMAGEWRAP_CLAMP_TO_EDGE:   return GL_CLAMP_TO_EDGE;
-        case EVA_IMAGEWRAP_CLAMP_TO_BORDER: return GL_CLAMP_TO_BORDER;
+static void _eva_state_indirect_buffer(unsigned int id) {
+    if (_eva_state_changed(_eva.state.indirect_buffer != id)) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, id);
+        _eva.state.indirect_buffer = id;
     }
-    return 0;
 }
 
-static int TranslateImageFilter(int filter) {
-    switch (filter) {
-        case EVA_IMAGEFILTER_NEAREST:                   return GL_NEAREST;
-        case EVA_IMAGEFILTER_LINEAR:                    return GL_LINEAR;
-        case EVA_IMAGEFILTER_NEAREST_MIPMAP_NEAREST:    return GL_NEAREST_MIPMAP_NEAREST;
-        case EVA_IMAGEFILTER_LINEAR_MIPMAP_NEAREST:     return GL_LINEAR_MIPMAP_NEAREST;
-        case EVA_IMAGEFILTER_NEAREST_MIPMAP_LINEAR:     return GL_NEAREST_MIPMAP_LINEAR;
-        case EVA_IMAGEFILTER_LINEAR_MIPMAP_LINEAR:      return GL_LINEAR_MIPMAP_LINEAR;
+static void _eva_state_uniform_buffer(int binding, unsigned int id, size_t size) {
+    if (_eva_state_changed(_eva.state.uniform_buffers[binding] != id)) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, id, 0, size);
+        _eva.state.uniform_buffers[binding] = id;
     }
-    return 0;
 }
 
-eva_buffer_t *eva_buffer_create(eva_buffer_desc_t *desc) {
-    if (_eva.initted == 0)
-        _eva_init();
-
-    eva_buffer_t *buffer = calloc(1, sizeof *buffer);
-
-    int type = (desc->layout[0] == 0) ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
-    int usage = (desc->data == NULL) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
-
-    glGenBuffers(1, &buffer->id);
-    glBindBuffer(type, buffer->id);
-    glBufferData(type, desc->size, desc->data, usage);
-    glBindBuffer(type, 0);
+static void _eva_state_texture(int unit, unsigned int target, unsigned int id) {
+    if (_eva_state_changed(_eva.state.textures[unit] != id)) {
+        if (_eva_state_changed(_eva.state.active_texture != unit)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            _eva.state.active_texture = unit;
+        }
+        glBindTexture(target, id);
+        _eva.state.textures[unit] = id;
+    }
+}
 
-    for (int i = 0; i < EVA_BUFFER_MAX_ATTRIBUTES && desc->layout[i] != 0; i++) {
-        size_t size;
-        buffer->attributes[i] = _eva_vertex_attr_translate(desc->layout[i], &size);
-        buffer->attributes[i].offset = buffer->stride;
-        buffer->stride += buffer->attributes[i].count * size;
+static void _eva_state_viewport(int x, int y, int w, int h) {
+    if (_eva_state_changed(_eva.state.viewport.x != x || _eva.state.viewport.y != y ||
+                           _eva.state.viewport.w != w || _eva.state.viewport.h != h)) {
+        glViewport(x, y, w, h);
+        _eva.state.viewport.x = x;
+        _eva.state.viewport.y = y;
+        _eva.state.viewport.w = w;
+        _eva.state.viewport.h = h;
+    }
+}
 
-        buffer->nattributes++;
+static void _eva_state_clear_color(float r, float g, float b, float a) {
+    if (_eva_state_changed(_eva.state.clear.r != r || _eva.state.clear.g != g ||
+                           _eva.state.clear.b != b || _eva.state.clear.a != a)) {
+        glClearColor(r, g, b, a);
+        _eva.state.clear.r = r;
+        _eva.state.clear.g = g;
+        _eva.state.clear.b = b;
+        _eva.state.clear.a = a;
     }
+}
 
-    return buffer;
+static void _eva_state_enable(unsigned int cap, int *enabled, int value) {
+    if (_eva_state_changed(*enabled != value)) {
+        if (value)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        *enabled = value;
+    }
 }
 
-eva_shader_t *eva_shader_create(eva_shader_desc_t *desc) {
-    if (_eva.initted == 0)
-        _eva_init();
+static void _eva_state_blend_func(unsigned int src_rgb, unsigned int dst_rgb, unsigned int src_alpha, unsigned int dst_alpha) {
+    if (_eva_state_changed(_eva.state.blend.src_rgb != src_rgb || _eva.state.blend.dst_rgb != dst_rgb ||
+                           _eva.state.blend.src_alpha != src_alpha || _eva.state.blend.dst_alpha != dst_alpha)) {
+        glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+        _eva.state.blend.src_rgb = src_rgb;
+        _eva.state.blend.dst_rgb = dst_rgb;
+        _eva.state.blend.src_alpha = src_alpha;
+        _eva.state.blend.dst_alpha = dst_alpha;
+    }
+}
 
-    eva_shader_t *shader = calloc(1, sizeof *shader);
-    shader->id = glCreateProgram();
+static void _eva_state_blend_equation(unsigned int op_rgb, unsigned int op_alpha) {
+    if (_eva_state_changed(_eva.state.blend.op_rgb != op_rgb || _eva.state.blend.op_alpha != op_alpha)) {
+        glBlendEquationSeparate(op_rgb, op_alpha);
+        _eva.state.blend.op_rgb = op_rgb;
+        _eva.state.blend.op_alpha = op_alpha;
+    }
+}
 
-    unsigned int vs = _eva_shader_stage_create(GL_VERTEX_SHADER, desc->sources[0].src);
-    unsigned int fs = _eva_shader_stage_create(GL_FRAGMENT_SHADER, desc->sources[1].src);
+static void _eva_state_color_mask(int mask) {
+    if (_eva_state_changed(_eva.state.blend.color_mask != mask)) {
+        glColorMask((mask & EVA_COLORMASK_R) != 0, (mask & EVA_COLORMASK_G) != 0, (mask & EVA_COLORMASK_B) != 0, (mask & EVA_COLORMASK_A) != 0);
+        _eva.state.blend.color_mask = mask;
+    }
+}
 
-    glAttachShader(shader->id, vs);
-    glAttachShader(shader->id, fs);
-    glLinkProgram(shader->id);
+static void _eva_state_depth_func(unsigned int func) {
+    if (_eva_state_changed(_eva.state.depth.func != func)) {
+        glDepthFunc(func);
+        _eva.state.depth.func = func;
+    }
+}
 
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+static void _eva_state_depth_mask(int write) {
+    if (_eva_state_changed(_eva.state.depth.write != write)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        _eva.state.depth.write = write;
+    }
+}
 
-    size_t offset = 0;
-    for (int i = 0; i < EVA_SHADER_MAX_UNIFORMS && desc->uniforms[i].name != NULL; i++) {
-        _eva_uniform_desc_t *u = &shader->uniforms[i];
-        u->format = desc->uniforms[i].format;
-        u->location = glGetUniformLocation(shader->id, desc->uniforms[i].name);
-        u->offset = offset;
+static void _eva_state_stencil_func(int face, unsigned int func, int ref, unsigned int read_mask) {
+    unsigned int gl_face = (face == 0) ? GL_FRONT : GL_BACK;
+    if (_eva_state_changed(_eva.state.stencil.faces[face].func != func || _eva.state.stencil.faces[face].ref != ref ||
+                           _eva.state.stencil.faces[face].read_mask != read_mask)) {
+        glStencilFuncSeparate(gl_face, func, ref, read_mask);
+        _eva.state.stencil.faces[face].func = func;
+        _eva.state.stencil.faces[face].ref = ref;
+        _eva.state.stencil.faces[face].read_mask = read_mask;
+    }
+}
 
-        if (i > 0) {
-            offset += _eva_uniform_format_size(desc->uniforms[i].format);
-        }
+static void _eva_state_stencil_op(int face, unsigned int fail, unsigned int depth_fail, unsigned int pass) {
+    unsigned int gl_face = (face == 0) ? GL_FRONT : GL_BACK;
+    if (_eva_state_changed(_eva.state.stencil.faces[face].fail != fail || _eva.state.stencil.faces[face].depth_fail != depth_fail ||
+                           _eva.state.stencil.faces[face].pass != pass)) {
+        glStencilOpSeparate(gl_face, fail, depth_fail, pass);
+        _eva.state.stencil.faces[face].fail = fail;
+        _eva.state.stencil.faces[face].depth_fail = depth_fail;
+        _eva.state.stencil.faces[face].pass = pass;
+    }
+}
 
-        shader->nuniforms++;
+static void _eva_state_stencil_mask(int face, unsigned int write_mask) {
+    unsigned int gl_face = (face == 0) ? GL_FRONT : GL_BACK;
+    if (_eva_state_changed(_eva.state.stencil.faces[face].write_mask != write_mask)) {
+        glStencilMaskSeparate(gl_face, write_mask);
+        _eva.state.stencil.faces[face].write_mask = write_mask;
     }
+}
 
-    return shader;
+static void _eva_state_cull_face(unsigned int face) {
+    if (_eva_state_changed(_eva.state.cull.face != face)) {
+        glCullFace(face);
+        _eva.state.cull.face = face;
+    }
 }
 
-eva_image_t *eva_image_create(eva_image_desc_t *desc) {
-    if (_eva.initted == 0)
-        _eva_init();
+static void _eva_state_front_face(unsigned int front_face) {
+    if (_eva_state_changed(_eva.state.cull.front_face != front_face)) {
+        glFrontFace(front_face);
+        _eva.state.cull.front_face = front_face;
+    }
+}
 
-    eva_image_t *image = calloc(1, sizeof *image);
-    image->width = desc->width;
-    image->height = desc->height;
+static void _eva_state_polygon_offset(float factor, float units) {
+    if (_eva_state_changed(_eva.state.offset.factor != factor || _eva.state.offset.units != units)) {
+        glPolygonOffset(factor, units);
+        _eva.state.offset.factor = factor;
+        _eva.state.offset.units = units;
+    }
+}
 
-    glGenTextures(1, &image->id);
-    glBindTexture(GL_TEXTURE_2D, image->id);
+// The shadow state starts out matching the defaults of a fresh context
+static void _eva_state_init(void) {
+    _eva.state.blend.src_rgb = _eva.state.blend.src_alpha = GL_ONE;
+    _eva.state.blend.dst_rgb = _eva.state.blend.dst_alpha = GL_ZERO;
+    _eva.state.blend.op_rgb = _eva.state.blend.op_alpha = GL_FUNC_ADD;
+    _eva.state.blend.color_mask = EVA_COLORMASK_RGBA;
+    _eva.state.depth.func = GL_LESS;
+    _eva.state.depth.write = 1;
+    for (int face = 0; face < 2; face++) {
+        _eva.state.stencil.faces[face].func = GL_ALWAYS;
+        _eva.state.stencil.faces[face].fail = GL_KEEP;
+        _eva.state.stencil.faces[face].depth_fail = GL_KEEP;
+        _eva.state.stencil.faces[face].pass = GL_KEEP;
+        _eva.state.stencil.faces[face].read_mask = 0xFFFFFFFF;
+        _eva.state.stencil.faces[face].write_mask = 0xFFFFFFFF;
+    }
+    _eva.state.cull.face = GL_BACK;
+    _eva.state.cull.front_face = GL_CCW;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, TranslateImageWrap(desc->wrap.s));
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, TranslateImageWrap(desc->wrap.t));
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, TranslateImageFilter(desc->filter.min));
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, TranslateImageFilter(desc->filter.mag));
+static void _eva_slots_create(_eva_slots_t *slots, char const *name, int capacity, size_t size) {
+    capacity = (capacity < (int)_EVA_SLOT_INDEX_MASK) ? capacity : (int)_EVA_SLOT_INDEX_MASK;
+    slots->items = calloc(capacity, size);
+    slots->generations = calloc(capacity, sizeof *slots->generations);
+    slots->free = malloc(capacity * sizeof *slots->free);
+    slots->capacity = capacity;
+    slots->size = size;
+    slots->name = name;
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, TranslateImageFormat(desc->format), desc->width, desc->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, desc->data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+// Handles pack a 1-based slot index under the slot generation, so an id of 0 never refers to anything. Every entry
+// point resolves the caller's handles through _eva_slots_get, so a stale one fails the generation check instead of
+// aliasing the next resource created in its slot
+static void *_eva_slots_alloc(_eva_slots_t *slots) {
+    int index;
+    if (slots->nfree > 0) {
+        index = slots->free[--slots->nfree];
+    } else if (slots->count < slots->capacity) {
+        index = slots->count++;
+    } else {
+        fprintf(stderr, "eva: out of %s slots (%d)\n", slots->name, slots->capacity);
+        return NULL;
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    return image;
+    void *item = slots->items + index * slots->size;
+    memset(item, 0, slots->size);
+    return item;
 }
 
-void eva_buffer_delete(eva_buffer_t *buffer) {
-    glDeleteBuffers(1, &buffer->id);
-    free(buffer);
+static void _eva_slots_free(_eva_slots_t *slots, void *item) {
+    int index = (int)(((unsigned char *)item - slots->items) / slots->size);
+    slots->generations[index] = (slots->generations[index] + 1) & (0xFFFFFFFFu >> _EVA_SLOT_INDEX_BITS);
+    memset(item, 0, slots->size);
+    slots->free[slots->nfree++] = index;
 }
 
-void eva_shader_delete(eva_shader_t *shader) {
-    glDeleteProgram(shader->id);
-    free(shader);
+// Freeing bumps the generation, so handles to deleted slots stop matching whether or not the slot was reused
+static void *_eva_slots_get(_eva_slots_t *slots, unsigned int id) {
+    int index = (int)(id & _EVA_SLOT_INDEX_MASK) - 1;
+    if (index < 0 || index >= slots->count || slots->generations[index] != (id >> _EVA_SLOT_INDEX_BITS))
+        return NULL;
+    return slots->items + index * slots->size;
 }
 
-void eva_image_delete(eva_image_t *image) {
-    glDeleteTextures(1, &image->id);
-    free(image);
+static unsigned int _eva_slots_id(_eva_slots_t *slots, void const *item) {
+    int index = (int)(((unsigned char const *)item - slots->items) / slots->size);
+    return ((unsigned int)slots->generations[index] << _EVA_SLOT_INDEX_BITS) | (unsigned int)(index + 1);
 }
 
-void eva_pass_begin(eva_pass_desc_t *desc) {
-    glViewport(desc->viewport.x, desc->viewport.y, desc->viewport.w, desc->viewport.h);
-    glClearColor(desc->clear.r, desc->clear.g, desc->clear.b, desc->clear.a);
-    glClear(GL_COLOR_BUFFER_BIT);
+static int _eva_has_extension(char const *name) {
+    int count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++)
+        if (strcmp((char const *)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+            return 1;
+    return 0;
 }
 
-void eva_uniforms_apply(void *data) {
-    glUseProgram(_eva.pipeline.shader->id);
+// glad.h is generated without extensions, so extension entry points are resolved through its loader by hand
+static GLADapiproc _eva_get_proc(char const *name) {
+    struct _glad_gl_userptr userptr = glad_gl_build_userptr(glad_gl_dlopen_handle());
+    GLADapiproc proc = glad_gl_get_proc(&userptr, name);
+    gladLoaderUnloadGL();
+    return proc;
+}
 
-    int texture_slot = 0;
-    for (int i = 0; i < _eva.pipeline.shader->nuniforms; i++) {
-        _eva_uniform_desc_t u = _eva.pipeline.shader->uniforms[i];
-        void *ptr = (char *)data + u.offset;
+static unsigned long long _eva_hash_string(unsigned long long hash, char const *str) {
+    while (str != NULL && *str != '\0')
+        hash = (hash ^ (unsigned char)*str++) * 1099511628211ull;
+    return (hash ^ 0xff) * 1099511628211ull;
+}
 
-        switch (u.format) {
-            case EVA_UNIFORMFORMAT_INT:     glUniform1iv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_INT2:    glUniform2iv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_INT3:    glUniform3iv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_INT4:    glUniform4iv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_FLOAT:   glUniform1fv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_FLOAT2:  glUniform2fv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_FLOAT3:  glUniform3fv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_FLOAT4:  glUniform4fv(u.location, 1, ptr);          break;
-            case EVA_UNIFORMFORMAT_MAT3:    glUniformMatrix3fv(u.location, 1, 0, ptr); break;
-            case EVA_UNIFORMFORMAT_MAT4:    glUniformMatrix4fv(u.location, 1, 0, ptr); break;
-            default:                                                                   break;
-        }
+static void _eva_caps_query(void) {
+    eva_caps_t *caps = &_eva.caps;
+    glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &caps->max_texture_units);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &caps->max_texture_size);
+    glGetIntegerv(GL_MAX_SAMPLES, &caps->max_samples);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &caps->uniform_buffer_alignment);
+
+    caps->draw_indirect = GLAD_GL_VERSION_4_0;
+    caps->multi_draw_indirect = GLAD_GL_VERSION_4_3;
+
+    // A driver may support the entry points while accepting no binary formats, which makes caching pointless
+    int formats = 0;
+    if (GLAD_GL_VERSION_4_1)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    caps->program_binary = formats > 0;
+    caps->texture_storage = GLAD_GL_VERSION_4_2;
+    caps->texture_storage_multisample = GLAD_GL_VERSION_4_3;
+    caps->invalidate_framebuffer = GLAD_GL_VERSION_4_3;
+    caps->persistent_mapping = GLAD_GL_VERSION_4_4;
+    caps->dsa = GLAD_GL_VERSION_4_5;
+
+    if (_eva_has_extension("GL_KHR_parallel_shader_compile")) {
+        _EVA_PFNGLMAXSHADERCOMPILERTHREADSKHRPROC max_threads = (_EVA_PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)_eva_get_proc("glMaxShaderCompilerThreadsKHR");
+        if (max_threads != NULL)
+            max_threads(0xFFFFFFFF);
+        caps->parallel_compile = 1;
     }
 
-    glUseProgram(0);
+    caps->texture_s3tc = _eva_has_extension("GL_EXT_texture_compression_s3tc");
+    caps->texture_bptc = GLAD_GL_VERSION_4_2 || _eva_has_extension("GL_ARB_texture_compression_bptc");
+    caps->texture_etc2 = GLAD_GL_VERSION_4_3 || _eva_has_extension("GL_ARB_ES3_compatibility");
+
+    if (_eva_has_extension("GL_ARB_bindless_texture")) {
+        _eva.bindless.get_handle = (_EVA_PFNGLGETTEXTUREHANDLEARBPROC)_eva_get_proc("glGetTextureHandleARB");
+        _eva.bindless.make_resident = (_EVA_PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)_eva_get_proc("glMakeTextureHandleResidentARB");
+        _eva.bindless.make_non_resident = (_EVA_PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)_eva_get_proc("glMakeTextureHandleNonResidentARB");
+        _eva.bindless.uniform_handle = (_EVA_PFNGLUNIFORMHANDLEUI64ARBPROC)_eva_get_proc("glUniformHandleui64ARB");
+        caps->bindless = _eva.bindless.get_handle != NULL && _eva.bindless.make_resident != NULL &&
+                         _eva.bindless.make_non_resident != NULL && _eva.bindless.uniform_handle != NULL;
+    }
 }
 
-void eva_bindings_apply(eva_bindings_desc_t *bindings) {
-    int index = 0;
-    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS && bindings->vbos[i] != NULL; i++) {
-        eva_buffer_t *vbo = bindings->vbos[i];
-        glBindBuffer(GL_ARRAY_BUFFER, vbo->id);
-
-        for (int j = 0; j < vbo->nattributes; j++) {
-            _eva_vertex_attr_desc_t va = vbo->attributes[j];
-            glEnableVertexAttribArray(index);
+// Creating a resource without calling this first sets up with the defaults
+void eva_setup(eva_setup_desc_t *desc) {
+    if (_eva.initted) {
+        fprintf(stderr, "eva: eva_setup called more than once\n");
+        return;
+    }
 
-            if (i == 0) {
-                glVertexAttribPointer(index, va.count, va.format, va.normalized, vbo->stride, (void *)va.offset);
-            } else {
-                glVertexAttribPointer(index, va.count, va.format, va.normalized, 0, 0);
-            }
+    eva_setup_desc_t defaults = {0};
+    if (desc == NULL)
+        desc = &defaults;
 
-            index++;
-        }
+    // initted stays 0, so the next create call tries again rather than running GL through null pointers
+    if (gladLoaderLoadGL() == 0) {
+        fprintf(stderr, "eva: could not load OpenGL, is a context current?\n");
+        return;
     }
 
-    if (bindings->ibo)
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bindings->ibo->id);
+    _eva_state_init();
+    _eva_caps_query();
 
-    for (int i = 0; i < EVA_BINDINGS_MAX_IMAGES && bindings->images[i] != NULL; i++) {
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, bindings->images[i]->id);
-    }
+    // Program binaries are only valid for the driver that wrote them, so its strings lead every cache key
+    _eva.driver_hash = 14695981039346656037ull;
+    _eva.driver_hash = _eva_hash_string(_eva.driver_hash, (char const *)glGetString(GL_VENDOR));
+    _eva.driver_hash = _eva_hash_string(_eva.driver_hash, (char const *)glGetString(GL_RENDERER));
+    _eva.driver_hash = _eva_hash_string(_eva.driver_hash, (char const *)glGetString(GL_VERSION));
 
-    _eva.bindings = *bindings;
-}
+    _eva_slots_create(&_eva.buffers, "buffer", desc->max_buffers > 0 ? desc->max_buffers : EVA_MAX_BUFFERS, sizeof(_eva_buffer_t));
+    _eva_slots_create(&_eva.shaders, "shader", desc->max_shaders > 0 ? desc->max_shaders : EVA_MAX_SHADERS, sizeof(_eva_shader_t));
+    _eva_slots_create(&_eva.images, "image", desc->max_images > 0 ? desc->max_images : EVA_MAX_IMAGES, sizeof(_eva_image_t));
+    _eva_slots_create(&_eva.framebuffers, "framebuffer", desc->max_framebuffers > 0 ? desc->max_framebuffers : EVA_MAX_FRAMEBUFFERS, sizeof(_eva_framebuffer_t));
 
-void eva_pipeline_apply(eva_pipeline_desc_t *pipeline) {
-    if (pipeline->shader != _eva.pipeline.shader)
-        glUseProgram(pipeline->shader->id);
+    glGenVertexArrays(1, &_eva.vao);
+    _eva_state_vao(_eva.vao);
 
-    _eva.pipeline = *pipeline;
+    _eva.initted = 1;
 }
 
-void eva_draw(int first, int count) {
-    if (_eva.bindings.ibo)
-        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, NULL);
-    else
-        glDrawArrays(GL_TRIANGLES, first, count);
+eva_caps_t eva_caps(void) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    return _eva.caps;
+}
+
+// Without DSA buffers are edited through GL_COPY_WRITE_BUFFER, which no cached VAO or draw-time binding uses
+static unsigned int _eva_buffer_gl_create(size_t size, void const *data, unsigned int usage) {
+    unsigned int id;
+    // Only static data gets immutable storage, everything else has to stay respecifiable for orphaning
+    if (_eva.caps.dsa) {
+        glCreateBuffers(1, &id);
+        if (size > 0 && usage == GL_STATIC_DRAW)
+            glNamedBufferStorage(id, size, data, GL_DYNAMIC_STORAGE_BIT);
+        else if (size > 0)
+            glNamedBufferData(id, size, data, usage);
+        return id;
+    }
+
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return id;
+}
+
+static void _eva_buffer_gl_write(unsigned int id, size_t offset, size_t size, void const *data) {
+    if (_eva.caps.dsa) {
+        glNamedBufferSubData(id, offset, size, data);
+        return;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static void _eva_buffer_gl_copy(unsigned int src, unsigned int dst, size_t src_offset, size_t dst_offset, size_t size) {
+    if (_eva.caps.dsa) {
+        glCopyNamedBufferSubData(src, dst, src_offset, dst_offset, size);
+        return;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, src);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_offset, dst_offset, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static _eva_vertex_attr_desc_t _eva_vertex_attr_translate(int format, size_t *size) {
+    switch (format) {
+        case EVA_VERTEXFORMAT_INT:    *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 1};
+        case EVA_VERTEXFORMAT_INT2:   *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 2};
+        case EVA_VERTEXFORMAT_INT3:   *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 3};
+        case EVA_VERTEXFORMAT_INT4:   *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_INT,   .count = 4};
+        case EVA_VERTEXFORMAT_FLOAT:  *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 1};
+        case EVA_VERTEXFORMAT_FLOAT2: *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 2};
+        case EVA_VERTEXFORMAT_FLOAT3: *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 3};
+        case EVA_VERTEXFORMAT_FLOAT4: *size = 4; return (_eva_vertex_attr_desc_t){.format = GL_FLOAT, .count = 4};
+    }
+    *size = 0;
+    return (_eva_vertex_attr_desc_t){0};
+}
+
+static size_t _eva_uniform_format_size(int format) {
+    switch (format) {
+        case EVA_UNIFORMFORMAT_INT:     return  1 * sizeof(int);
+        case EVA_UNIFORMFORMAT_INT2:    return  2 * sizeof(int);
+        case EVA_UNIFORMFORMAT_INT3:    return  3 * sizeof(int);
+        case EVA_UNIFORMFORMAT_INT4:    return  4 * sizeof(int);
+        case EVA_UNIFORMFORMAT_FLOAT:   return  1 * sizeof(float);
+        case EVA_UNIFORMFORMAT_FLOAT2:  return  2 * sizeof(float);
+        case EVA_UNIFORMFORMAT_FLOAT3:  return  3 * sizeof(float);
+        case EVA_UNIFORMFORMAT_FLOAT4:  return  4 * sizeof(float);
+        case EVA_UNIFORMFORMAT_MAT3:    return 12 * sizeof(float);
+        case EVA_UNIFORMFORMAT_MAT4:    return 16 * sizeof(float);
+        case EVA_UNIFORMFORMAT_IMAGE2D: return  1 * sizeof(int);
+        case EVA_UNIFORMFORMAT_HANDLE:  return  1 * sizeof(unsigned long long);
+    }
+    return 0;
+}
+
+static size_t _eva_uniform_std140_align(int format) {
+    switch (format) {
+        case EVA_UNIFORMFORMAT_INT:     return  4;
+        case EVA_UNIFORMFORMAT_INT2:    return  8;
+        case EVA_UNIFORMFORMAT_INT3:    return 16;
+        case EVA_UNIFORMFORMAT_INT4:    return 16;
+        case EVA_UNIFORMFORMAT_FLOAT:   return  4;
+        case EVA_UNIFORMFORMAT_FLOAT2:  return  8;
+        case EVA_UNIFORMFORMAT_FLOAT3:  return 16;
+        case EVA_UNIFORMFORMAT_FLOAT4:  return 16;
+        case EVA_UNIFORMFORMAT_MAT3:    return 16;
+        case EVA_UNIFORMFORMAT_MAT4:    return 16;
+        case EVA_UNIFORMFORMAT_HANDLE:  return  8;
+    }
+    return 0;
+}
+
+static unsigned int _eva_resident_slot(unsigned long long handle) {
+    unsigned int mask = (unsigned int)_eva.resident.capacity * 2 - 1;
+    unsigned int index = (unsigned int)((handle * 11400714819323198485ull) >> 32) & mask;
+    while (_eva.resident.table[index] != NULL && _eva.resident.table[index]->handle != handle)
+        index = (index + 1) & mask;
+    return index;
+}
+
+static void _eva_resident_insert(_eva_image_t *image) {
+    _eva.resident.table[_eva_resident_slot(image->handle)] = image;
+}
+
+// Later entries in the probe run are shifted back over the hole, so lookups never need tombstones
+static void _eva_resident_remove(_eva_image_t *image) {
+    unsigned int mask = (unsigned int)_eva.resident.capacity * 2 - 1;
+    unsigned int hole = _eva_resident_slot(image->handle);
+    _eva.resident.table[hole] = NULL;
+
+    for (unsigned int i = (hole + 1) & mask; _eva.resident.table[i] != NULL; i = (i + 1) & mask) {
+        _eva_image_t *moved = _eva.resident.table[i];
+        _eva.resident.table[i] = NULL;
+        _eva_resident_insert(moved);
+    }
+}
+
+// Handles fetched in an earlier pass and kept in uniform data still count as used by this one
+static void _eva_image_touch_handle(unsigned long long handle) {
+    if (_eva.resident.count == 0 || handle == 0)
+        return;
+
+    _eva_image_t *image = _eva.resident.table[_eva_resident_slot(handle)];
+    if (image != NULL)
+        image->last_used = _eva.resident.epoch;
+}
+
+static void _eva_shader_block_create(_eva_shader_t *shader, eva_shader_desc_t *desc) {
+    unsigned int index = glGetUniformBlockIndex(shader->id, desc->block.name);
+    if (index == GL_INVALID_INDEX || desc->block.binding < 0 || desc->block.binding >= EVA_SHADER_MAX_BLOCKS) {
+        fprintf(stderr, "eva: uniform block '%s' unavailable, falling back to glUniform\n", desc->block.name);
+        return;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < shader->nuniforms; i++) {
+        _eva_uniform_desc_t *u = &shader->uniforms[i];
+        size_t align = _eva_uniform_std140_align(u->format);
+        if (align == 0)
+            continue;
+
+        offset = (offset + align - 1) & ~(align - 1);
+        u->block_offset = offset;
+        offset += _eva_uniform_format_size(u->format);
+    }
+
+    int reported = 0;
+    glGetActiveUniformBlockiv(shader->id, index, GL_UNIFORM_BLOCK_DATA_SIZE, &reported);
+    offset = (offset + 15) & ~(size_t)15;
+    if ((size_t)reported > offset)
+        offset = reported;
+
+    glUniformBlockBinding(shader->id, index, desc->block.binding);
+
+    shader->block.binding = desc->block.binding;
+    shader->block.size = offset;
+
+    // The buffer behind a binding is shared, and only grows when a shader declares a larger block
+    _eva_block_t *block = &_eva.blocks[desc->block.binding];
+    if (block->size < offset) {
+        if (block->id != 0) {
+            if (_eva.state.uniform_buffers[desc->block.binding] == block->id)
+                _eva.state.uniform_buffers[desc->block.binding] = 0;
+            glDeleteBuffers(1, &block->id);
+        }
+
+        block->data = realloc(block->data, offset);
+        memset(block->data + block->size, 0, offset - block->size);
+        block->size = offset;
+        block->id = _eva_buffer_gl_create(offset, NULL, GL_DYNAMIC_DRAW);
+        block->dirty = 1;
+    }
+    block->refs++;
+}
+
+static void _eva_shader_block_apply(_eva_shader_t *shader, void *data) {
+    _eva_block_t *block = &_eva.blocks[shader->block.binding];
+
+    for (int i = 0; i < shader->nuniforms; i++) {
+        _eva_uniform_desc_t u = shader->uniforms[i];
+        if (_eva_uniform_std140_align(u.format) == 0)
+            continue;
+
+        size_t size = _eva_uniform_format_size(u.format);
+        unsigned char *src = (unsigned char *)data + u.offset;
+        unsigned char *dst = block->data + u.block_offset;
+
+        // glUniformMatrix3fv reads 9 packed floats, std140 wants each column padded out to a vec4
+        float columns[12] = {0};
+        if (u.format == EVA_UNIFORMFORMAT_MAT3) {
+            for (int c = 0; c < 3; c++)
+                memcpy(&columns[c * 4], src + c * 3 * sizeof(float), 3 * sizeof(float));
+            src = (unsigned char *)columns;
+        }
+
+        if (u.format == EVA_UNIFORMFORMAT_HANDLE && _eva.caps.bindless) {
+            unsigned long long handle;
+            memcpy(&handle, src, sizeof handle);
+            _eva_image_touch_handle(handle);
+        }
+
+        if (memcmp(dst, src, size) != 0) {
+            memcpy(dst, src, size);
+            block->dirty = 1;
+        }
+    }
+
+    if (block->dirty) {
+        _eva_buffer_gl_write(block->id, 0, block->size, block->data);
+        block->dirty = 0;
+    }
+
+    _eva_state_uniform_buffer(shader->block.binding, block->id, block->size);
+}
+
+static unsigned int _eva_shader_stage_create(int stage, char const *src) {
+    unsigned int shader = glCreateShader(stage);
+    glShaderSource(shader, 1, &src, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+static void _eva_shader_stage_check(unsigned int shader) {
+    int success = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (success == 0) {
+        char log[512] = {0};
+        glGetShaderInfoLog(shader, sizeof log, NULL, log);
+        fprintf(stderr, "%s\n", log);
+    }
+}
+
+static _eva_shader_pending_t *_eva_shader_pending_create(eva_shader_desc_t *desc) {
+    size_t size = 0;
+    for (int i = 0; i < EVA_SHADER_MAX_UNIFORMS && desc->uniforms[i].name != NULL; i++)
+        size += strlen(desc->uniforms[i].name) + 1;
+    if (desc->block.name != NULL)
+        size += strlen(desc->block.name) + 1;
+
+    _eva_shader_pending_t *pending = calloc(1, sizeof *pending + size);
+    pending->desc = *desc;
+    pending->desc.sources[0].src = NULL;
+    pending->desc.sources[1].src = NULL;
+    pending->desc.cache_dir = NULL;
+
+    // Uniform lookups happen after the link finishes, so keep copies of the names the caller passed in
+    char *str = pending->strings;
+    for (int i = 0; i < EVA_SHADER_MAX_UNIFORMS && desc->uniforms[i].name != NULL; i++) {
+        pending->desc.uniforms[i].name = strcpy(str, desc->uniforms[i].name);
+        str += strlen(str) + 1;
+    }
+    if (desc->block.name != NULL)
+        pending->desc.block.name = strcpy(str, desc->block.name);
+
+    return pending;
+}
+
+typedef struct _eva_program_binary_header_t {
+    char magic[4];
+    unsigned int format;
+    unsigned long long hash;
+    unsigned int length;
+} _eva_program_binary_header_t;
+
+static unsigned long long _eva_shader_cache_hash(eva_shader_desc_t *desc) {
+    unsigned long long hash = _eva.driver_hash;
+    hash = _eva_hash_string(hash, desc->sources[0].src);
+    hash = _eva_hash_string(hash, desc->sources[1].src);
+    return hash;
+}
+
+static int _eva_shader_cache_load(unsigned int program, char const *path, unsigned long long hash) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+
+    _eva_program_binary_header_t header = {0};
+    void *binary = NULL;
+    int linked = 0;
+
+    if (fread(&header, sizeof header, 1, file) == 1 && memcmp(header.magic, "EVAB", 4) == 0 && header.hash == hash) {
+        binary = malloc(header.length);
+        if (binary != NULL && fread(binary, 1, header.length, file) == header.length) {
+            glProgramBinary(program, header.format, binary, header.length);
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+    }
+
+    free(binary);
+    fclose(file);
+    return linked;
+}
+
+static void _eva_shader_cache_save(unsigned int program, char const *path, unsigned long long hash) {
+    int linked = 0, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (linked == 0 || length <= 0)
+        return;
+
+    _eva_program_binary_header_t header = {.magic = {'E', 'V', 'A', 'B'}, .hash = hash};
+    void *binary = malloc(length);
+    glGetProgramBinary(program, length, NULL, &header.format, binary);
+    header.length = length;
+
+    FILE *file = fopen(path, "wb");
+    if (file != NULL) {
+        fwrite(&header, sizeof header, 1, file);
+        fwrite(binary, 1, length, file);
+        fclose(file);
+    }
+
+    free(binary);
+}
+
+static int TranslateImageFormat(int format) {
+    switch (format) {
+        case EVA_IMAGEFORMAT_RGBA8:         return GL_RGBA8;
+        case EVA_IMAGEFORMAT_RGB8:          return GL_RGB8;
+        case EVA_IMAGEFORMAT_BC1:           return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case EVA_IMAGEFORMAT_BC3:           return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case EVA_IMAGEFORMAT_BC4:           return GL_COMPRESSED_RED_RGTC1;
+        case EVA_IMAGEFORMAT_BC5:           return GL_COMPRESSED_RG_RGTC2;
+        case EVA_IMAGEFORMAT_BC7:           return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case EVA_IMAGEFORMAT_ETC2_RGB8:     return GL_COMPRESSED_RGB8_ETC2;
+        case EVA_IMAGEFORMAT_ETC2_RGBA8:    return GL_COMPRESSED_RGBA8_ETC2_EAC;
+        case EVA_IMAGEFORMAT_RGBA16F:       return GL_RGBA16F;
+        case EVA_IMAGEFORMAT_DEPTH:         return GL_DEPTH_COMPONENT32F;
+        case EVA_IMAGEFORMAT_DEPTH_STENCIL: return GL_DEPTH24_STENCIL8;
+    }
+    return 0;
+}
+
+// Client-side pixel layout used to upload uncompressed formats
+static int _eva_image_format_transfer(int format, unsigned int *gl_format, unsigned int *gl_type) {
+    switch (format) {
+        case EVA_IMAGEFORMAT_RGBA16F:       *gl_format = GL_RGBA;            *gl_type = GL_HALF_FLOAT;               return 8;
+        case EVA_IMAGEFORMAT_DEPTH:         *gl_format = GL_DEPTH_COMPONENT; *gl_type = GL_FLOAT;                    return 4;
+        case EVA_IMAGEFORMAT_DEPTH_STENCIL: *gl_format = GL_DEPTH_STENCIL;   *gl_type = GL_UNSIGNED_INT_24_8;        return 4;
+    }
+    *gl_format = GL_RGBA;
+    *gl_type = GL_UNSIGNED_BYTE;
+    return 4;
+}
+
+// Bytes per 4x4 block for compressed formats, 0 for formats uploaded as RGBA bytes
+static int _eva_image_format_block_size(int format) {
+    switch (format) {
+        case EVA_IMAGEFORMAT_BC1:           return  8;
+        case EVA_IMAGEFORMAT_BC3:           return 16;
+        case EVA_IMAGEFORMAT_BC4:           return  8;
+        case EVA_IMAGEFORMAT_BC5:           return 16;
+        case EVA_IMAGEFORMAT_BC7:           return 16;
+        case EVA_IMAGEFORMAT_ETC2_RGB8:     return  8;
+        case EVA_IMAGEFORMAT_ETC2_RGBA8:    return 16;
+    }
+    return 0;
+}
+
+static int TranslateImageType(int type) {
+    switch (type) {
+        case EVA_IMAGETYPE_2D:      return GL_TEXTURE_2D;
+        case EVA_IMAGETYPE_ARRAY:   return GL_TEXTURE_2D_ARRAY;
+        case EVA_IMAGETYPE_3D:      return GL_TEXTURE_3D;
+    }
+    return 0;
+}
+
+static int TranslateImageWrap(int wrap) {
+    switch (wrap) {
+        case EVA_IMAGEWRAP_REPEAT:          return GL_REPEAT;
+        case EVA_IMAGEWRAP_MIRRORED_REPEAT: return GL_MIRRORED_REPEAT;
+        case EVA_IMAGEWRAP_CLAMP_TO_EDGE:   return GL_CLAMP_TO_EDGE;
+        case EVA_IMAGEWRAP_CLAMP_TO_BORDER: return GL_CLAMP_TO_BORDER;
+    }
+    return 0;
+}
+
+static int TranslateImageFilter(int filter) {
+    switch (filter) {
+        case EVA_IMAGEFILTER_NEAREST:                   return GL_NEAREST;
+        case EVA_IMAGEFILTER_LINEAR:                    return GL_LINEAR;
+        case EVA_IMAGEFILTER_NEAREST_MIPMAP_NEAREST:    return GL_NEAREST_MIPMAP_NEAREST;
+        case EVA_IMAGEFILTER_LINEAR_MIPMAP_NEAREST:     return GL_LINEAR_MIPMAP_NEAREST;
+        case EVA_IMAGEFILTER_NEAREST_MIPMAP_LINEAR:     return GL_NEAREST_MIPMAP_LINEAR;
+        case EVA_IMAGEFILTER_LINEAR_MIPMAP_LINEAR:      return GL_LINEAR_MIPMAP_LINEAR;
+    }
+    return 0;
+}
+
+static int TranslatePrimitiveType(int primitive) {
+    switch (primitive) {
+        case EVA_PRIMITIVETYPE_TRIANGLES:       return GL_TRIANGLES;
+        case EVA_PRIMITIVETYPE_TRIANGLE_STRIP:  return GL_TRIANGLE_STRIP;
+        case EVA_PRIMITIVETYPE_LINES:           return GL_LINES;
+        case EVA_PRIMITIVETYPE_LINE_STRIP:      return GL_LINE_STRIP;
+        case EVA_PRIMITIVETYPE_POINTS:          return GL_POINTS;
+    }
+    return GL_TRIANGLES;
+}
+
+static int TranslateBlendFactor(int factor, int fallback) {
+    switch (factor) {
+        case EVA_BLENDFACTOR_ZERO:                  return GL_ZERO;
+        case EVA_BLENDFACTOR_ONE:                   return GL_ONE;
+        case EVA_BLENDFACTOR_SRC_COLOR:             return GL_SRC_COLOR;
+        case EVA_BLENDFACTOR_ONE_MINUS_SRC_COLOR:   return GL_ONE_MINUS_SRC_COLOR;
+        case EVA_BLENDFACTOR_SRC_ALPHA:             return GL_SRC_ALPHA;
+        case EVA_BLENDFACTOR_ONE_MINUS_SRC_ALPHA:   return GL_ONE_MINUS_SRC_ALPHA;
+        case EVA_BLENDFACTOR_DST_COLOR:             return GL_DST_COLOR;
+        case EVA_BLENDFACTOR_ONE_MINUS_DST_COLOR:   return GL_ONE_MINUS_DST_COLOR;
+        case EVA_BLENDFACTOR_DST_ALPHA:             return GL_DST_ALPHA;
+        case EVA_BLENDFACTOR_ONE_MINUS_DST_ALPHA:   return GL_ONE_MINUS_DST_ALPHA;
+    }
+    return fallback;
+}
+
+static int TranslateBlendOp(int op) {
+    switch (op) {
+        case EVA_BLENDOP_ADD:               return GL_FUNC_ADD;
+        case EVA_BLENDOP_SUBTRACT:          return GL_FUNC_SUBTRACT;
+        case EVA_BLENDOP_REVERSE_SUBTRACT:  return GL_FUNC_REVERSE_SUBTRACT;
+        case EVA_BLENDOP_MIN:               return GL_MIN;
+        case EVA_BLENDOP_MAX:               return GL_MAX;
+    }
+    return GL_FUNC_ADD;
+}
+
+static int TranslateCompareFunc(int compare) {
+    switch (compare) {
+        case EVA_COMPAREFUNC_ALWAYS:    return GL_ALWAYS;
+        case EVA_COMPAREFUNC_NEVER:     return GL_NEVER;
+        case EVA_COMPAREFUNC_LESS:      return GL_LESS;
+        case EVA_COMPAREFUNC_LEQUAL:    return GL_LEQUAL;
+        case EVA_COMPAREFUNC_EQUAL:     return GL_EQUAL;
+        case EVA_COMPAREFUNC_GEQUAL:    return GL_GEQUAL;
+        case EVA_COMPAREFUNC_GREATER:   return GL_GREATER;
+        case EVA_COMPAREFUNC_NOTEQUAL:  return GL_NOTEQUAL;
+    }
+    return GL_ALWAYS;
+}
+
+static int TranslateStencilOp(int op) {
+    switch (op) {
+        case EVA_STENCILOP_KEEP:        return GL_KEEP;
+        case EVA_STENCILOP_ZERO:        return GL_ZERO;
+        case EVA_STENCILOP_REPLACE:     return GL_REPLACE;
+        case EVA_STENCILOP_INCR:        return GL_INCR;
+        case EVA_STENCILOP_DECR:        return GL_DECR;
+        case EVA_STENCILOP_INVERT:      return GL_INVERT;
+        case EVA_STENCILOP_INCR_WRAP:   return GL_INCR_WRAP;
+        case EVA_STENCILOP_DECR_WRAP:   return GL_DECR_WRAP;
+    }
+    return GL_KEEP;
+}
+
+static unsigned int _eva_vao_hash(_eva_bindings_t *bindings) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i <= EVA_BINDINGS_MAX_VBOS; i++) {
+        size_t key = (size_t)((i < EVA_BINDINGS_MAX_VBOS) ? bindings->vbos[i] : bindings->ibo);
+        hash = (hash ^ (unsigned int)(key >> 4)) * 16777619u;
+    }
+    return hash;
+}
+
+static int _eva_vao_matches(_eva_vao_t *vao, unsigned int hash, _eva_bindings_t *bindings) {
+    if (vao->hash != hash || vao->ibo != bindings->ibo)
+        return 0;
+
+    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS; i++)
+        if (vao->vbos[i] != bindings->vbos[i])
+            return 0;
+
+    return 1;
+}
+
+static void _eva_vao_flush(void) {
+    for (int i = 0; i < EVA_BINDINGS_CACHE_SIZE; i++) {
+        if (_eva.vaos.entries[i].state == _EVA_VAOSTATE_USED)
+            glDeleteVertexArrays(1, &_eva.vaos.entries[i].id);
+        _eva.vaos.entries[i] = (_eva_vao_t){0};
+    }
+    _eva.vaos.count = 0;
+    _eva.state.vao = 0;
+}
+
+static void _eva_vao_specify(_eva_bindings_t *bindings) {
+    int index = 0;
+    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS && bindings->vbos[i] != NULL; i++) {
+        _eva_buffer_t *vbo = bindings->vbos[i];
+        _eva_state_array_buffer(vbo->id);
+
+        for (int j = 0; j < vbo->nattributes; j++) {
+            _eva_vertex_attr_desc_t va = vbo->attributes[j];
+            glEnableVertexAttribArray(index);
+            glVertexAttribPointer(index, va.count, va.format, va.normalized, vbo->stride, (void *)va.offset);
+            if (vbo->divisor != 0)
+                glVertexAttribDivisor(index, vbo->divisor);
+            index++;
+        }
+    }
+
+    if (bindings->ibo)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bindings->ibo->id);
+}
+
+// Each vbo gets its own buffer binding point, so the VAO is built without binding anything
+static void _eva_vao_specify_dsa(unsigned int vao, _eva_bindings_t *bindings) {
+    int index = 0;
+    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS && bindings->vbos[i] != NULL; i++) {
+        _eva_buffer_t *vbo = bindings->vbos[i];
+        glVertexArrayVertexBuffer(vao, i, vbo->id, 0, vbo->stride);
+        if (vbo->divisor != 0)
+            glVertexArrayBindingDivisor(vao, i, vbo->divisor);
+
+        for (int j = 0; j < vbo->nattributes; j++) {
+            _eva_vertex_attr_desc_t va = vbo->attributes[j];
+            glEnableVertexArrayAttrib(vao, index);
+            glVertexArrayAttribFormat(vao, index, va.count, va.format, va.normalized, va.offset);
+            glVertexArrayAttribBinding(vao, index, i);
+            index++;
+        }
+    }
+
+    if (bindings->ibo)
+        glVertexArrayElementBuffer(vao, bindings->ibo->id);
+}
+
+static unsigned int _eva_vao_lookup(_eva_bindings_t *bindings) {
+    unsigned int hash = _eva_vao_hash(bindings);
+    unsigned int mask = EVA_BINDINGS_CACHE_SIZE - 1;
+    _eva_vao_t *slot = NULL;
+
+    for (unsigned int i = 0; i < EVA_BINDINGS_CACHE_SIZE; i++) {
+        _eva_vao_t *vao = &_eva.vaos.entries[(hash + i) & mask];
+        if (vao->state == _EVA_VAOSTATE_USED && _eva_vao_matches(vao, hash, bindings))
+            return vao->id;
+        if (vao->state != _EVA_VAOSTATE_USED && slot == NULL)
+            slot = vao;
+        if (vao->state == _EVA_VAOSTATE_EMPTY)
+            break;
+    }
+
+    // Keep the probe sequences short; rebuilding the cache is cheap compared to a miss on every apply
+    if (slot == NULL || _eva.vaos.count >= EVA_BINDINGS_CACHE_SIZE * 3 / 4) {
+        _eva_vao_flush();
+        slot = &_eva.vaos.entries[hash & mask];
+    }
+
+    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS; i++)
+        slot->vbos[i] = bindings->vbos[i];
+    slot->ibo = bindings->ibo;
+    slot->hash = hash;
+    slot->state = _EVA_VAOSTATE_USED;
+    _eva.vaos.count++;
+
+    if (_eva.caps.dsa) {
+        glCreateVertexArrays(1, &slot->id);
+        _eva_vao_specify_dsa(slot->id, bindings);
+    } else {
+        glGenVertexArrays(1, &slot->id);
+        _eva_state_vao(slot->id);
+        _eva_vao_specify(bindings);
+    }
+
+    return slot->id;
+}
+
+static void _eva_vao_evict(_eva_buffer_t *buffer) {
+    for (int i = 0; i < EVA_BINDINGS_CACHE_SIZE; i++) {
+        _eva_vao_t *vao = &_eva.vaos.entries[i];
+        if (vao->state != _EVA_VAOSTATE_USED)
+            continue;
+
+        int uses = (vao->ibo == buffer);
+        for (int j = 0; j < EVA_BINDINGS_MAX_VBOS && !uses; j++)
+            uses = (vao->vbos[j] == buffer);
+
+        if (uses) {
+            if (_eva.state.vao == vao->id)
+                _eva.state.vao = 0;
+            glDeleteVertexArrays(1, &vao->id);
+            *vao = (_eva_vao_t){.state = _EVA_VAOSTATE_DELETED};
+            _eva.vaos.count--;
+        }
+    }
+}
+
+static size_t _eva_buffer_align(_eva_buffer_t *buffer, size_t offset) {
+    size_t align = (buffer->stride != 0) ? buffer->stride : 4;
+    return (offset + align - 1) / align * align;
+}
+
+static void _eva_buffer_stream_wait(_eva_buffer_t *buffer, int region) {
+    GLsync fence = buffer->stream.fences[region];
+    if (fence == NULL)
+        return;
+
+    int result = glClientWaitSync(fence, 0, 0);
+    while (result == GL_TIMEOUT_EXPIRED)
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+
+    glDeleteSync(fence);
+    buffer->stream.fences[region] = NULL;
+}
+
+static void _eva_buffer_stream_advance(_eva_buffer_t *buffer) {
+    buffer->stream.fences[buffer->stream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    buffer->stream.region = (buffer->stream.region + 1) % EVA_BUFFER_STREAM_REGIONS;
+    buffer->stream.cursor = buffer->stream.region * buffer->stream.region_size;
+    _eva_buffer_stream_wait(buffer, buffer->stream.region);
+}
+
+static void _eva_buffer_stream_create(_eva_buffer_t *buffer, eva_buffer_desc_t *desc) {
+    int flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    size_t capacity = buffer->stream.region_size * EVA_BUFFER_STREAM_REGIONS;
+
+    if (_eva.caps.dsa) {
+        glCreateBuffers(1, &buffer->id);
+        glNamedBufferStorage(buffer->id, capacity, NULL, flags);
+        buffer->stream.mapped = glMapNamedBufferRange(buffer->id, 0, capacity, flags);
+    } else {
+        glGenBuffers(1, &buffer->id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->id);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, NULL, flags);
+        buffer->stream.mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    if (desc->data != NULL) {
+        memcpy(buffer->stream.mapped, desc->data, desc->size);
+        buffer->stream.cursor = desc->size;
+    }
+}
+
+eva_buffer_t eva_buffer_create(eva_buffer_desc_t *desc) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    _eva_buffer_t *buffer = _eva_slots_alloc(&_eva.buffers);
+    if (buffer == NULL)
+        return (eva_buffer_t){0};
+
+    for (int i = 0; i < EVA_BUFFER_MAX_ATTRIBUTES && desc->layout[i] != 0; i++) {
+        size_t size;
+        buffer->attributes[i] = _eva_vertex_attr_translate(desc->layout[i], &size);
+        buffer->attributes[i].offset = buffer->stride;
+        buffer->stride += buffer->attributes[i].count * size;
+
+        buffer->nattributes++;
+    }
+
+    buffer->size = desc->size;
+    buffer->type = desc->type;
+    buffer->divisor = desc->divisor;
+    buffer->index_type = (desc->index_format == EVA_INDEXFORMAT_UINT16) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    buffer->index_size = (desc->index_format == EVA_INDEXFORMAT_UINT16) ? 2 : 4;
+    buffer->usage = (desc->data == NULL || desc->usage == EVA_BUFFERUSAGE_STREAM) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+    buffer->stream.region_size = _eva_buffer_align(buffer, desc->size);
+
+    // Persistent mapping needs glBufferStorage (4.4); older contexts stream by orphaning instead
+    if (desc->usage == EVA_BUFFERUSAGE_STREAM && _eva.caps.persistent_mapping) {
+        _eva_buffer_stream_create(buffer, desc);
+        return (eva_buffer_t){_eva_slots_id(&_eva.buffers, buffer)};
+    }
+
+    // The element array binding is part of VAO state, so initialize through a target no cached VAO sees
+    buffer->id = _eva_buffer_gl_create(desc->size, desc->data, buffer->usage);
+
+    if (desc->data != NULL)
+        buffer->stream.cursor = desc->size;
+
+    return (eva_buffer_t){_eva_slots_id(&_eva.buffers, buffer)};
+}
+
+size_t eva_buffer_update(eva_buffer_t handle, void const *data, size_t size) {
+    _eva_buffer_t *buffer = _eva_slots_get(&_eva.buffers, handle.id);
+    if (buffer == NULL) {
+        fprintf(stderr, "eva: buffer was deleted\n");
+        return 0;
+    }
+
+    if (buffer->stream.mapped != NULL) {
+        if (buffer->stream.cursor != buffer->stream.region * buffer->stream.region_size)
+            _eva_buffer_stream_advance(buffer);
+    } else {
+        buffer->stream.cursor = buffer->size;
+    }
+
+    return eva_buffer_append(handle, data, size);
+}
+
+size_t eva_buffer_append(eva_buffer_t handle, void const *data, size_t size) {
+    _eva_buffer_t *buffer = _eva_slots_get(&_eva.buffers, handle.id);
+    if (buffer == NULL) {
+        fprintf(stderr, "eva: buffer was deleted\n");
+        return 0;
+    }
+
+    if (size > buffer->size) {
+        fprintf(stderr, "eva: %zu bytes do not fit in a %zu byte buffer\n", size, buffer->size);
+        return 0;
+    }
+
+    if (buffer->stream.mapped != NULL) {
+        size_t offset = _eva_buffer_align(buffer, buffer->stream.cursor);
+        size_t end = (buffer->stream.region + 1) * buffer->stream.region_size;
+        if (offset + size > end) {
+            _eva_buffer_stream_advance(buffer);
+            offset = buffer->stream.cursor;
+        }
+
+        memcpy(buffer->stream.mapped + offset, data, size);
+        buffer->stream.cursor = offset + size;
+        return offset;
+    }
+
+    size_t offset = _eva_buffer_align(buffer, buffer->stream.cursor);
+
+    // Static buffers under DSA have immutable storage, so they are invalidated rather than orphaned
+    if (offset + size > buffer->size) {
+        if (_eva.caps.dsa && buffer->usage == GL_STATIC_DRAW) {
+            glInvalidateBufferData(buffer->id);
+        } else if (_eva.caps.dsa) {
+            glNamedBufferData(buffer->id, buffer->size, NULL, buffer->usage);
+        } else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->id);
+            glBufferData(GL_COPY_WRITE_BUFFER, buffer->size, NULL, buffer->usage);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        offset = 0;
+    }
+    _eva_buffer_gl_write(buffer->id, offset, size, data);
+
+    buffer->stream.cursor = offset + size;
+    return offset;
+}
+
+static int _eva_buddy_create(_eva_buddy_t *buddy, int capacity) {
+    buddy->orders = 1;
+    while ((EVA_POOL_MIN_BLOCK << (buddy->orders - 1)) < capacity) {
+        if (buddy->orders == _EVA_BUDDY_MAX_ORDERS)
+            return 0;
+        buddy->orders++;
+    }
+
+    for (int k = 0; k < buddy->orders; k++)
+        buddy->bits[k] = calloc(((1 << (buddy->orders - 1 - k)) + 63) / 64, sizeof *buddy->bits[k]);
+
+    buddy->bits[buddy->orders - 1][0] = 1;
+    buddy->nfree[buddy->orders - 1] = 1;
+    return 1;
+}
+
+static void _eva_buddy_destroy(_eva_buddy_t *buddy) {
+    for (int k = 0; k < buddy->orders; k++)
+        free(buddy->bits[k]);
+}
+
+static int _eva_buddy_capacity(_eva_buddy_t *buddy) {
+    return EVA_POOL_MIN_BLOCK << (buddy->orders - 1);
+}
+
+static void _eva_buddy_set(_eva_buddy_t *buddy, int order, int block, int value) {
+    unsigned long long bit = 1ull << (block & 63);
+    if (value)
+        buddy->bits[order][block >> 6] |= bit;
+    else
+        buddy->bits[order][block >> 6] &= ~bit;
+    buddy->nfree[order] += value ? 1 : -1;
+}
+
+static int _eva_buddy_order(_eva_buddy_t *buddy, int count) {
+    int order = 0;
+    while (order < buddy->orders && (EVA_POOL_MIN_BLOCK << order) < count)
+        order++;
+    return (order < buddy->orders) ? order : -1;
+}
+
+// Returns an offset in elements, or -1 when no block of the order is free
+static int _eva_buddy_alloc(_eva_buddy_t *buddy, int order) {
+    int k = order;
+    while (k < buddy->orders && buddy->nfree[k] == 0)
+        k++;
+    if (k == buddy->orders)
+        return -1;
+
+    int block = 0;
+    unsigned long long *bits = buddy->bits[k];
+    while (bits[block >> 6] == 0)
+        block += 64;
+    while ((bits[block >> 6] & (1ull << (block & 63))) == 0)
+        block++;
+    _eva_buddy_set(buddy, k, block, 0);
+
+    // Split down to the requested order, leaving each upper half free
+    for (; k > order; k--) {
+        block *= 2;
+        _eva_buddy_set(buddy, k - 1, block + 1, 1);
+    }
+
+    return block * (EVA_POOL_MIN_BLOCK << order);
+}
+
+static void _eva_buddy_free(_eva_buddy_t *buddy, int offset, int order) {
+    int block = offset / (EVA_POOL_MIN_BLOCK << order);
+    for (; order < buddy->orders - 1; order++) {
+        int buddy_block = block ^ 1;
+        if ((buddy->bits[order][buddy_block >> 6] & (1ull << (buddy_block & 63))) == 0)
+            break;
+        _eva_buddy_set(buddy, order, buddy_block, 0);
+        block >>= 1;
+    }
+    _eva_buddy_set(buddy, order, block, 1);
+}
+
+// Marks everything from offset onwards free, in the largest aligned blocks that fit
+static void _eva_buddy_reset(_eva_buddy_t *buddy, int offset) {
+    for (int k = 0; k < buddy->orders; k++) {
+        memset(buddy->bits[k], 0, ((1 << (buddy->orders - 1 - k)) + 63) / 64 * sizeof *buddy->bits[k]);
+        buddy->nfree[k] = 0;
+    }
+
+    int capacity = _eva_buddy_capacity(buddy);
+    while (offset < capacity) {
+        int order = buddy->orders - 1;
+        while (offset % (EVA_POOL_MIN_BLOCK << order) != 0)
+            order--;
+        _eva_buddy_set(buddy, order, offset / (EVA_POOL_MIN_BLOCK << order), 1);
+        offset += EVA_POOL_MIN_BLOCK << order;
+    }
+}
+
+static size_t _eva_pool_stride(int const *layout) {
+    size_t stride = 0;
+    for (int i = 0; i < EVA_BUFFER_MAX_ATTRIBUTES && layout[i] != 0; i++) {
+        size_t size;
+        stride += _eva_vertex_attr_translate(layout[i], &size).count * size;
+    }
+    return stride;
+}
+
+eva_pool_t *eva_pool_create(eva_pool_desc_t *desc) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    eva_pool_t *pool = calloc(1, sizeof *pool);
+    pool->free_mesh = -1;
+
+    if (!_eva_buddy_create(&pool->vertices, desc->vertices) || (desc->indices > 0 && !_eva_buddy_create(&pool->indices, desc->indices))) {
+        fprintf(stderr, "eva: pool of %d vertices and %d indices is too large\n", desc->vertices, desc->indices);
+        _eva_buddy_destroy(&pool->vertices);
+        free(pool);
+        return NULL;
+    }
+
+    // Capacities are rounded up to a power of two so the buddy blocks tile the buffers exactly
+    eva_buffer_desc_t vbo = {.size = (size_t)_eva_buddy_capacity(&pool->vertices) * _eva_pool_stride(desc->layout)};
+    memcpy(vbo.layout, desc->layout, sizeof vbo.layout);
+    pool->vbo = eva_buffer_create(&vbo);
+
+    if (desc->indices > 0) {
+        size_t index_size = (desc->index_format == EVA_INDEXFORMAT_UINT16) ? 2 : 4;
+        eva_buffer_desc_t ibo = {.size = (size_t)_eva_buddy_capacity(&pool->indices) * index_size, .index_format = desc->index_format};
+        pool->ibo = eva_buffer_create(&ibo);
+    }
+
+    if (pool->vbo.id == 0 || (desc->indices > 0 && pool->ibo.id == 0)) {
+        eva_buffer_delete(pool->vbo);
+        _eva_buddy_destroy(&pool->vertices);
+        _eva_buddy_destroy(&pool->indices);
+        free(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+static int _eva_pool_block_compare(void const *a, void const *b) {
+    _eva_pool_block_t const *x = a, *y = b;
+    if (x->order != y->order)
+        return y->order - x->order;
+    return *x->offset - *y->offset;
+}
+
+// Placing blocks largest first keeps every one aligned to its own size, so the packed layout is still a valid buddy layout
+static void _eva_pool_repack(_eva_buddy_t *buddy, _eva_buffer_t *buffer, size_t element, _eva_pool_block_t *blocks, int count) {
+    qsort(blocks, count, sizeof *blocks, _eva_pool_block_compare);
+
+    int used = 0;
+    for (int i = 0; i < count; i++)
+        used += EVA_POOL_MIN_BLOCK << blocks[i].order;
+
+    // Ranges within one buffer may not overlap in glCopyBufferSubData, so the live data goes through a scratch buffer
+    if (used > 0) {
+        unsigned int scratch = _eva_buffer_gl_create((size_t)used * element, NULL, GL_STREAM_COPY);
+
+        int cursor = 0;
+        for (int i = 0; i < count; i++) {
+            if (blocks[i].count > 0)
+                _eva_buffer_gl_copy(buffer->id, scratch, (size_t)*blocks[i].offset * element, (size_t)cursor * element, (size_t)blocks[i].count * element);
+            *blocks[i].offset = cursor;
+            cursor += EVA_POOL_MIN_BLOCK << blocks[i].order;
+        }
+
+        _eva_buffer_gl_copy(scratch, buffer->id, 0, 0, (size_t)used * element);
+        glDeleteBuffers(1, &scratch);
+    }
+
+    _eva_buddy_reset(buddy, used);
+}
+
+void eva_pool_compact(eva_pool_t *pool) {
+    _eva_buffer_t *vbo = _eva_slots_get(&_eva.buffers, pool->vbo.id);
+    _eva_buffer_t *ibo = _eva_slots_get(&_eva.buffers, pool->ibo.id);
+    if (vbo == NULL || (pool->ibo.id != 0 && ibo == NULL)) {
+        fprintf(stderr, "eva: pool buffers were deleted\n");
+        return;
+    }
+
+    _eva_pool_block_t *blocks = malloc((pool->nmeshes > 0 ? pool->nmeshes : 1) * sizeof *blocks);
+
+    int count = 0;
+    for (int i = 0; i < pool->nmeshes; i++)
+        if (pool->meshes[i].live)
+            blocks[count++] = (_eva_pool_block_t){&pool->meshes[i].vertex_offset, pool->meshes[i].vertex_order, pool->meshes[i].nvertices};
+    _eva_pool_repack(&pool->vertices, vbo, vbo->stride, blocks, count);
+
+    if (ibo != NULL) {
+        count = 0;
+        for (int i = 0; i < pool->nmeshes; i++)
+            if (pool->meshes[i].live)
+                blocks[count++] = (_eva_pool_block_t){&pool->meshes[i].index_offset, pool->meshes[i].index_order, pool->meshes[i].nindices};
+        _eva_pool_repack(&pool->indices, ibo, ibo->index_size, blocks, count);
+    }
+
+    free(blocks);
+}
+
+static int _eva_pool_reserve(eva_pool_t *pool, _eva_pool_mesh_t *mesh) {
+    mesh->vertex_offset = _eva_buddy_alloc(&pool->vertices, mesh->vertex_order);
+    if (mesh->vertex_offset < 0)
+        return 0;
+
+    if (pool->ibo.id != 0) {
+        mesh->index_offset = _eva_buddy_alloc(&pool->indices, mesh->index_order);
+        if (mesh->index_offset < 0) {
+            _eva_buddy_free(&pool->vertices, mesh->vertex_offset, mesh->vertex_order);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int eva_pool_alloc(eva_pool_t *pool, eva_mesh_desc_t *desc) {
+    _eva_buffer_t *vbo = _eva_slots_get(&_eva.buffers, pool->vbo.id);
+    _eva_buffer_t *ibo = _eva_slots_get(&_eva.buffers, pool->ibo.id);
+    if (vbo == NULL || (pool->ibo.id != 0 && ibo == NULL)) {
+        fprintf(stderr, "eva: pool buffers were deleted\n");
+        return -1;
+    }
+
+    _eva_pool_mesh_t mesh = {
+        .vertex_order = _eva_buddy_order(&pool->vertices, desc->nvertices),
+        .index_order  = (pool->ibo.id != 0) ? _eva_buddy_order(&pool->indices, desc->nindices) : 0,
+        .nvertices    = desc->nvertices,
+        .nindices     = (pool->ibo.id != 0) ? desc->nindices : 0,
+        .live         = 1,
+    };
+
+    if (mesh.vertex_order < 0 || mesh.index_order < 0) {
+        fprintf(stderr, "eva: mesh of %d vertices and %d indices does not fit in the pool\n", desc->nvertices, desc->nindices);
+        return -1;
+    }
+
+    // Compacting moves every mesh, so it's left to the caller rather than done behind meshes they still hold
+    if (!_eva_pool_reserve(pool, &mesh)) {
+        fprintf(stderr, "eva: pool is full or fragmented, eva_pool_compact may make room\n");
+        return -1;
+    }
+
+    int id = pool->free_mesh;
+    if (id >= 0) {
+        pool->free_mesh = pool->meshes[id].next;
+    } else {
+        if (pool->nmeshes == pool->capacity) {
+            pool->capacity = (pool->capacity > 0) ? pool->capacity * 2 : 64;
+            pool->meshes = realloc(pool->meshes, pool->capacity * sizeof *pool->meshes);
+        }
+        id = pool->nmeshes++;
+    }
+    pool->meshes[id] = mesh;
+
+    if (desc->vertices != NULL)
+        _eva_buffer_gl_write(vbo->id, (size_t)mesh.vertex_offset * vbo->stride, (size_t)mesh.nvertices * vbo->stride, desc->vertices);
+    if (desc->indices != NULL && ibo != NULL)
+        _eva_buffer_gl_write(ibo->id, (size_t)mesh.index_offset * ibo->index_size, (size_t)mesh.nindices * ibo->index_size, desc->indices);
+
+    return id;
+}
+
+eva_mesh_t eva_pool_mesh(eva_pool_t *pool, int id) {
+    if (id < 0 || id >= pool->nmeshes || !pool->meshes[id].live) {
+        fprintf(stderr, "eva: mesh %d is not in the pool\n", id);
+        return (eva_mesh_t){0};
+    }
+
+    _eva_pool_mesh_t *mesh = &pool->meshes[id];
+    if (pool->ibo.id != 0)
+        return (eva_mesh_t){.first = mesh->index_offset, .count = mesh->nindices, .base_vertex = mesh->vertex_offset};
+    return (eva_mesh_t){.first = 0, .count = mesh->nvertices, .base_vertex = mesh->vertex_offset};
+}
+
+void eva_pool_free(eva_pool_t *pool, int id) {
+    if (id < 0 || id >= pool->nmeshes || !pool->meshes[id].live) {
+        fprintf(stderr, "eva: mesh %d is not in the pool\n", id);
+        return;
+    }
+
+    _eva_pool_mesh_t *mesh = &pool->meshes[id];
+    _eva_buddy_free(&pool->vertices, mesh->vertex_offset, mesh->vertex_order);
+    if (pool->ibo.id != 0)
+        _eva_buddy_free(&pool->indices, mesh->index_offset, mesh->index_order);
+
+    mesh->live = 0;
+    mesh->next = pool->free_mesh;
+    pool->free_mesh = id;
+}
+
+void eva_pool_bindings(eva_pool_t *pool, eva_bindings_desc_t *bindings) {
+    bindings->vbos[0] = pool->vbo;
+    bindings->ibo = pool->ibo;
+}
+
+static void _eva_shader_finalize(_eva_shader_t *shader) {
+    _eva_shader_pending_t *pending = shader->pending;
+    eva_shader_desc_t *desc = &pending->desc;
+
+    if (pending->stages[0] != 0) {
+        int linked = 0;
+        glGetProgramiv(shader->id, GL_LINK_STATUS, &linked);
+        if (linked == 0) {
+            char log[512] = {0};
+            _eva_shader_stage_check(pending->stages[0]);
+            _eva_shader_stage_check(pending->stages[1]);
+            glGetProgramInfoLog(shader->id, sizeof log, NULL, log);
+            fprintf(stderr, "%s\n", log);
+        }
+
+        glDeleteShader(pending->stages[0]);
+        glDeleteShader(pending->stages[1]);
+
+        if (pending->path[0] != '\0')
+            _eva_shader_cache_save(shader->id, pending->path, pending->hash);
+    }
+
+    for (int i = 0; i < shader->nuniforms; i++)
+        shader->uniforms[i].location = glGetUniformLocation(shader->id, desc->uniforms[i].name);
+
+    if (desc->block.name != NULL)
+        _eva_shader_block_create(shader, desc);
+
+    free(pending);
+    shader->pending = NULL;
+}
+
+eva_shader_t eva_shader_create(eva_shader_desc_t *desc) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    _eva_shader_t *shader = _eva_slots_alloc(&_eva.shaders);
+    if (shader == NULL)
+        return (eva_shader_t){0};
+
+    shader->pending = _eva_shader_pending_create(desc);
+    shader->id = glCreateProgram();
+
+    size_t offset = 0;
+    for (int i = 0; i < EVA_SHADER_MAX_UNIFORMS && desc->uniforms[i].name != NULL; i++) {
+        _eva_uniform_desc_t *u = &shader->uniforms[i];
+        u->format = desc->uniforms[i].format;
+        u->offset = offset;
+        offset += _eva_uniform_format_size(desc->uniforms[i].format);
+
+        shader->nuniforms++;
+    }
+
+    shader->uniforms_size = offset;
+
+    _eva_shader_pending_t *pending = shader->pending;
+
+    int cached = 0;
+    if (desc->cache_dir != NULL && _eva.caps.program_binary) {
+        pending->hash = _eva_shader_cache_hash(desc);
+        snprintf(pending->path, sizeof pending->path, "%s/%016llx.evab", desc->cache_dir, pending->hash);
+        cached = _eva_shader_cache_load(shader->id, pending->path, pending->hash);
+
+        // A rejected binary can leave the program in an undefined state, so start over with a fresh one
+        if (cached == 0) {
+            glDeleteProgram(shader->id);
+            shader->id = glCreateProgram();
+            glProgramParameteri(shader->id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    if (cached == 0) {
+        pending->stages[0] = _eva_shader_stage_create(GL_VERTEX_SHADER, desc->sources[0].src);
+        pending->stages[1] = _eva_shader_stage_create(GL_FRAGMENT_SHADER, desc->sources[1].src);
+
+        glAttachShader(shader->id, pending->stages[0]);
+        glAttachShader(shader->id, pending->stages[1]);
+        glLinkProgram(shader->id);
+    }
+
+    // Querying any status forces the driver to finish the compile, so async shaders wait for eva_shader_ready
+    if (cached || desc->async == 0)
+        _eva_shader_finalize(shader);
+
+    return (eva_shader_t){_eva_slots_id(&_eva.shaders, shader)};
+}
+
+int eva_shader_ready(eva_shader_t handle) {
+    _eva_shader_t *shader = _eva_slots_get(&_eva.shaders, handle.id);
+    if (shader == NULL) {
+        fprintf(stderr, "eva: shader was deleted\n");
+        return 0;
+    }
+
+    if (shader->pending == NULL)
+        return 1;
+
+    if (_eva.caps.parallel_compile) {
+        int complete = 0;
+        glGetProgramiv(shader->id, GL_COMPLETION_STATUS_KHR, &complete);
+        if (complete == 0)
+            return 0;
+    }
+
+    _eva_shader_finalize(shader);
+    return 1;
+}
+
+static int _eva_fence_signaled(GLsync fence, unsigned long long timeout) {
+    int result = glClientWaitSync(fence, (timeout != 0) ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+static _eva_staging_t *_eva_staging_acquire(size_t size) {
+    _eva_staging_t *found = NULL;
+
+    for (int i = 0; i < _eva.staging.count && found == NULL; i++) {
+        _eva_staging_t *staging = &_eva.staging.buffers[i];
+        if (staging->fence != NULL && _eva_fence_signaled(staging->fence, 0)) {
+            glDeleteSync(staging->fence);
+            staging->fence = NULL;
+        }
+        if (staging->fence == NULL && staging->size >= size)
+            found = staging;
+    }
+
+    if (found == NULL && _eva.staging.count < EVA_IMAGE_STAGING_BUFFERS) {
+        found = &_eva.staging.buffers[_eva.staging.count++];
+        glGenBuffers(1, &found->id);
+    }
+
+    // Every buffer is busy or too small, so grow an idle one, else wait on the oldest submission
+    if (found == NULL) {
+        found = &_eva.staging.buffers[0];
+        for (int i = 1; i < _eva.staging.count; i++) {
+            _eva_staging_t *staging = &_eva.staging.buffers[i];
+            if (found->fence == NULL)
+                break;
+            if (staging->fence == NULL || staging->serial < found->serial)
+                found = staging;
+        }
+    }
+
+    if (found->fence != NULL) {
+        while (!_eva_fence_signaled(found->fence, 1000000))
+            ;
+        glDeleteSync(found->fence);
+        found->fence = NULL;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, found->id);
+    if (found->size < size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        found->size = size;
+    }
+
+    return found;
+}
+
+static int _eva_image_mipmap_size(int size, int level) {
+    return (size >> level) > 0 ? (size >> level) : 1;
+}
+
+static void _eva_image_describe(_eva_image_t *image, eva_image_desc_t *desc) {
+    image->target = TranslateImageType(desc->type);
+    image->format = desc->format;
+    image->width = desc->width;
+    image->height = desc->height;
+    image->depth = (desc->type != EVA_IMAGETYPE_2D && desc->depth > 0) ? desc->depth : 1;
+    image->samples = (desc->samples > 1) ? desc->samples : 1;
+
+    int size = (desc->width > desc->height) ? desc->width : desc->height;
+    if (desc->type == EVA_IMAGETYPE_3D && image->depth > size)
+        size = image->depth;
+
+    int full = 1;
+    for (; size > 1 && full < EVA_IMAGE_MAX_MIPMAPS; size >>= 1)
+        full++;
+
+    if (image->samples > 1) {
+        image->target = desc->render_only ? GL_RENDERBUFFER : GL_TEXTURE_2D_MULTISAMPLE;
+        image->depth = 1;
+        image->mipmaps = 1;
+    } else if (desc->mipmaps.count > 0) {
+        // Storage past the 1x1 level is rejected by GL, so a count from the caller or a file stops at the full chain
+        if (desc->mipmaps.count > full)
+            fprintf(stderr, "eva: %d mipmaps requested but a %dx%d image has %d, clamping\n", desc->mipmaps.count, desc->width, desc->height, full);
+        image->mipmaps = (desc->mipmaps.count < full) ? desc->mipmaps.count : full;
+    } else if (desc->filter.min == EVA_IMAGEFILTER_NEAREST || desc->filter.min == EVA_IMAGEFILTER_LINEAR) {
+        image->mipmaps = 1;
+    } else if (_eva_image_format_block_size(desc->format) != 0) {
+        // Compressed chains can't be generated, so levels the caller didn't supply could never be filled
+        image->mipmaps = 1;
+    } else {
+        image->mipmaps = full;
+    }
+}
+
+// Array layers stay constant across levels while a 3D texture's depth shrinks with them
+static int _eva_image_mipmap_depth(_eva_image_t *image, int level) {
+    return (image->target == GL_TEXTURE_3D) ? _eva_image_mipmap_size(image->depth, level) : image->depth;
+}
+
+static size_t _eva_image_layer_bytes(_eva_image_t *image, int level) {
+    size_t w = _eva_image_mipmap_size(image->width, level);
+    size_t h = _eva_image_mipmap_size(image->height, level);
+    int block = _eva_image_format_block_size(image->format);
+
+    if (block != 0)
+        return ((w + 3) / 4) * ((h + 3) / 4) * block;
+
+    unsigned int gl_format, gl_type;
+    return w * h * _eva_image_format_transfer(image->format, &gl_format, &gl_type);
+}
+
+static size_t _eva_image_mipmap_bytes(_eva_image_t *image, int level) {
+    return _eva_image_layer_bytes(image, level) * _eva_image_mipmap_depth(image, level);
+}
+
+static void const *_eva_image_mipmap_data(eva_image_desc_t *desc, int level) {
+    if (desc->mipmaps.data[level] != NULL)
+        return desc->mipmaps.data[level];
+    return (level == 0) ? desc->data : NULL;
+}
+
+static void _eva_image_mipmap_upload(_eva_image_t *image, int level, int layer, int layers, void const *data) {
+    int w = _eva_image_mipmap_size(image->width, level);
+    int h = _eva_image_mipmap_size(image->height, level);
+    int compressed = _eva_image_format_block_size(image->format) != 0;
+    size_t size = _eva_image_layer_bytes(image, level) * layers;
+    if (compressed && size > INT_MAX) {
+        fprintf(stderr, "eva: level %d of %zu bytes is too large to upload\n", level, size);
+        return;
+    }
+
+    unsigned int gl_format, gl_type;
+    _eva_image_format_transfer(image->format, &gl_format, &gl_type);
+
+    if (_eva.caps.dsa && image->target == GL_TEXTURE_2D) {
+        if (compressed)
+            glCompressedTextureSubImage2D(image->id, level, 0, 0, w, h, TranslateImageFormat(image->format), (int)size, data);
+        else
+            glTextureSubImage2D(image->id, level, 0, 0, w, h, gl_format, gl_type, data);
+    } else if (_eva.caps.dsa) {
+        if (compressed)
+            glCompressedTextureSubImage3D(image->id, level, 0, 0, layer, w, h, layers, TranslateImageFormat(image->format), (int)size, data);
+        else
+            glTextureSubImage3D(image->id, level, 0, 0, layer, w, h, layers, gl_format, gl_type, data);
+    } else if (image->target == GL_TEXTURE_2D) {
+        if (compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, TranslateImageFormat(image->format), (int)size, data);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, gl_format, gl_type, data);
+    } else {
+        if (compressed)
+            glCompressedTexSubImage3D(image->target, level, 0, 0, layer, w, h, layers, TranslateImageFormat(image->format), (int)size, data);
+        else
+            glTexSubImage3D(image->target, level, 0, 0, layer, w, h, layers, gl_format, gl_type, data);
+    }
+}
+
+static void _eva_image_storage(_eva_image_t *image) {
+    int format = TranslateImageFormat(image->format);
+    int compressed = _eva_image_format_block_size(image->format) != 0;
+
+    unsigned int gl_format, gl_type;
+    _eva_image_format_transfer(image->format, &gl_format, &gl_type);
+
+    if (_eva.caps.dsa) {
+        if (image->target == GL_TEXTURE_2D)
+            glTextureStorage2D(image->id, image->mipmaps, format, image->width, image->height);
+        else
+            glTextureStorage3D(image->id, image->mipmaps, format, image->width, image->height, image->depth);
+        return;
+    }
+
+    if (_eva.caps.texture_storage) {
+        if (image->target == GL_TEXTURE_2D)
+            glTexStorage2D(GL_TEXTURE_2D, image->mipmaps, format, image->width, image->height);
+        else
+            glTexStorage3D(image->target, image->mipmaps, format, image->width, image->height, image->depth);
+        return;
+    }
+
+    for (int level = 0; level < image->mipmaps; level++) {
+        int w = _eva_image_mipmap_size(image->width, level);
+        int h = _eva_image_mipmap_size(image->height, level);
+        int d = _eva_image_mipmap_depth(image, level);
+        int size = _eva_image_mipmap_bytes(image, level);
+
+        if (image->target == GL_TEXTURE_2D && compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, size, NULL);
+        else if (image->target == GL_TEXTURE_2D)
+            glTexImage2D(GL_TEXTURE_2D, level, format, w, h, 0, gl_format, gl_type, NULL);
+        else if (compressed)
+            glCompressedTexImage3D(image->target, level, format, w, h, d, 0, size, NULL);
+        else
+            glTexImage3D(image->target, level, format, w, h, d, 0, gl_format, gl_type, NULL);
+    }
+}
+
+static void _eva_image_upload(_eva_image_t *image, eva_image_desc_t *desc) {
+    for (int level = 0; level < image->mipmaps; level++) {
+        void const *data = _eva_image_mipmap_data(desc, level);
+        if (data != NULL)
+            _eva_image_mipmap_upload(image, level, 0, _eva_image_mipmap_depth(image, level), data);
+    }
+}
+
+// Returns 0 when the staging buffer couldn't be mapped and the upload went through client memory instead
+static int _eva_image_upload_async(_eva_image_t *image, eva_image_desc_t *desc) {
+    size_t offsets[EVA_IMAGE_MAX_MIPMAPS] = {0};
+    size_t size = 0;
+
+    for (int level = 0; level < image->mipmaps; level++) {
+        offsets[level] = size;
+        if (_eva_image_mipmap_data(desc, level) != NULL)
+            size += _eva_image_mipmap_bytes(image, level);
+    }
+
+    _eva_staging_t *staging = _eva_staging_acquire(size);
+
+    unsigned char *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (ptr == NULL) {
+        fprintf(stderr, "eva: could not map a staging buffer, uploading synchronously\n");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        _eva_image_upload(image, desc);
+        return 0;
+    }
+
+    for (int level = 0; level < image->mipmaps; level++) {
+        void const *data = _eva_image_mipmap_data(desc, level);
+        if (data != NULL)
+            memcpy(ptr + offsets[level], data, _eva_image_mipmap_bytes(image, level));
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    for (int level = 0; level < image->mipmaps; level++)
+        if (_eva_image_mipmap_data(desc, level) != NULL)
+            _eva_image_mipmap_upload(image, level, 0, _eva_image_mipmap_depth(image, level), (void *)offsets[level]);
+
+    // Leaving the unpack buffer bound would turn every later client pointer into a buffer offset
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    staging->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    staging->serial = ++_eva.staging.serial;
+    return 1;
+}
+
+// With DSA images are edited by name, otherwise through the binding on the active unit
+static void _eva_image_parameter(_eva_image_t *image, unsigned int name, int value) {
+    if (_eva.caps.dsa)
+        glTextureParameteri(image->id, name, value);
+    else
+        glTexParameteri(image->target, name, value);
+}
+
+static void _eva_image_multisample(_eva_image_t *image) {
+    int format = TranslateImageFormat(image->format);
+
+    if (image->target == GL_RENDERBUFFER && _eva.caps.dsa) {
+        glCreateRenderbuffers(1, &image->id);
+        glNamedRenderbufferStorageMultisample(image->id, image->samples, format, image->width, image->height);
+        return;
+    }
+
+    if (image->target == GL_RENDERBUFFER) {
+        glGenRenderbuffers(1, &image->id);
+        glBindRenderbuffer(GL_RENDERBUFFER, image->id);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, image->samples, format, image->width, image->height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        return;
+    }
+
+    // Multisampled textures have no sampler state or mipmaps, and their contents can only come from rendering
+    if (_eva.caps.dsa) {
+        glCreateTextures(image->target, 1, &image->id);
+        glTextureStorage2DMultisample(image->id, image->samples, format, image->width, image->height, GL_TRUE);
+        return;
+    }
+
+    glGenTextures(1, &image->id);
+    _eva_state_texture(_eva.state.active_texture, image->target, image->id);
+
+    if (_eva.caps.texture_storage_multisample)
+        glTexStorage2DMultisample(image->target, image->samples, format, image->width, image->height, GL_TRUE);
+    else
+        glTexImage2DMultisample(image->target, image->samples, format, image->width, image->height, GL_TRUE);
+}
+
+eva_image_t eva_image_create(eva_image_desc_t *desc) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    _eva_image_t *image = _eva_slots_alloc(&_eva.images);
+    if (image == NULL)
+        return (eva_image_t){0};
+
+    _eva_image_describe(image, desc);
+
+    if (image->samples > 1) {
+        _eva_image_multisample(image);
+        return (eva_image_t){_eva_slots_id(&_eva.images, image)};
+    }
+
+    if (_eva.caps.dsa) {
+        glCreateTextures(image->target, 1, &image->id);
+    } else {
+        glGenTextures(1, &image->id);
+        _eva_state_texture(_eva.state.active_texture, image->target, image->id);
+    }
+
+    _eva_image_parameter(image, GL_TEXTURE_WRAP_S, TranslateImageWrap(desc->wrap.s));
+    _eva_image_parameter(image, GL_TEXTURE_WRAP_T, TranslateImageWrap(desc->wrap.t));
+    if (image->target == GL_TEXTURE_3D)
+        _eva_image_parameter(image, GL_TEXTURE_WRAP_R, TranslateImageWrap(desc->wrap.r));
+    _eva_image_parameter(image, GL_TEXTURE_MIN_FILTER, TranslateImageFilter(desc->filter.min));
+    _eva_image_parameter(image, GL_TEXTURE_MAG_FILTER, TranslateImageFilter(desc->filter.mag));
+    _eva_image_parameter(image, GL_TEXTURE_MAX_LEVEL, image->mipmaps - 1);
+
+    _eva_image_storage(image);
+
+    int async = desc->async && _eva_image_mipmap_data(desc, 0) != NULL;
+    if (async)
+        async = _eva_image_upload_async(image, desc);
+    else
+        _eva_image_upload(image, desc);
+
+    // Without an explicit count, mipmapped filters keep the old behaviour of generating the whole chain.
+    // Compressed formats cannot be rendered to, so their chains always have to come from the caller.
+    int compressed = _eva_image_format_block_size(image->format) != 0;
+    int generate = desc->mipmaps.generate || (desc->mipmaps.count == 0 && image->mipmaps > 1);
+    if (generate && image->mipmaps > 1 && !compressed && _eva.caps.dsa)
+        glGenerateTextureMipmap(image->id);
+    else if (generate && image->mipmaps > 1 && !compressed)
+        glGenerateMipmap(image->target);
+
+    if (async)
+        image->upload = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    return (eva_image_t){_eva_slots_id(&_eva.images, image)};
+}
+
+void eva_image_update(eva_image_t handle, int level, int layer, void const *data) {
+    _eva_image_t *image = _eva_slots_get(&_eva.images, handle.id);
+    if (image == NULL) {
+        fprintf(stderr, "eva: image was deleted\n");
+        return;
+    }
+
+    if (image->samples > 1) {
+        fprintf(stderr, "eva: multisampled images cannot be updated\n");
+        return;
+    }
+
+    if (level < 0 || level >= image->mipmaps || layer < 0 || layer >= _eva_image_mipmap_depth(image, level)) {
+        fprintf(stderr, "eva: image level %d layer %d is out of range\n", level, layer);
+        return;
+    }
+
+    if (!_eva.caps.dsa)
+        _eva_state_texture(_eva.state.active_texture, image->target, image->id);
+    _eva_image_mipmap_upload(image, level, layer, 1, data);
+}
+
+static void _eva_framebuffer_attach(_eva_framebuffer_t *framebuffer, unsigned int attachment, _eva_image_t *image, eva_attachment_desc_t *desc) {
+    if (_eva.caps.dsa && image->target == GL_RENDERBUFFER)
+        glNamedFramebufferRenderbuffer(framebuffer->id, attachment, GL_RENDERBUFFER, image->id);
+    else if (_eva.caps.dsa && (image->target == GL_TEXTURE_2D || image->target == GL_TEXTURE_2D_MULTISAMPLE))
+        glNamedFramebufferTexture(framebuffer->id, attachment, image->id, desc->level);
+    else if (_eva.caps.dsa)
+        glNamedFramebufferTextureLayer(framebuffer->id, attachment, image->id, desc->level, desc->layer);
+    else if (image->target == GL_RENDERBUFFER)
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, image->id);
+    else if (image->target == GL_TEXTURE_2D || image->target == GL_TEXTURE_2D_MULTISAMPLE)
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, image->target, image->id, desc->level);
+    else
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, image->id, desc->level, desc->layer);
+}
+
+eva_framebuffer_t eva_framebuffer_create(eva_framebuffer_desc_t *desc) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    // Colors first, then depth, with the handles resolved up front so nothing is created for a stale one
+    _eva_image_t *images[EVA_FRAMEBUFFER_MAX_COLORS + 1] = {0};
+    for (int i = 0; i <= EVA_FRAMEBUFFER_MAX_COLORS; i++) {
+        eva_image_t handle = (i < EVA_FRAMEBUFFER_MAX_COLORS) ? desc->colors[i].image : desc->depth.image;
+        if (handle.id != 0 && (images[i] = _eva_slots_get(&_eva.images, handle.id)) == NULL) {
+            fprintf(stderr, "eva: framebuffer references a deleted image\n");
+            return (eva_framebuffer_t){0};
+        }
+    }
+    _eva_image_t *depth = images[EVA_FRAMEBUFFER_MAX_COLORS];
+
+    _eva_framebuffer_t *framebuffer = _eva_slots_alloc(&_eva.framebuffers);
+    if (framebuffer == NULL)
+        return (eva_framebuffer_t){0};
+
+    unsigned int previous = _eva.state.framebuffer;
+    if (_eva.caps.dsa) {
+        glCreateFramebuffers(1, &framebuffer->id);
+    } else {
+        glGenFramebuffers(1, &framebuffer->id);
+        _eva_state_framebuffer(framebuffer->id);
+    }
+
+    unsigned int draw_buffers[EVA_FRAMEBUFFER_MAX_COLORS];
+    _eva_image_t *sized = NULL;
+
+    for (int i = 0; i < EVA_FRAMEBUFFER_MAX_COLORS && images[i] != NULL; i++) {
+        _eva_framebuffer_attach(framebuffer, GL_COLOR_ATTACHMENT0 + i, images[i], &desc->colors[i]);
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        sized = images[i];
+        framebuffer->samples = sized->samples;
+        framebuffer->ncolors++;
+    }
+
+    if (depth != NULL) {
+        framebuffer->depth = 1;
+        framebuffer->stencil = (depth->format == EVA_IMAGEFORMAT_DEPTH_STENCIL);
+        _eva_framebuffer_attach(framebuffer, framebuffer->stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, depth, &desc->depth);
+        sized = (sized != NULL) ? sized : depth;
+        framebuffer->samples = depth->samples;
+    }
+
+    if (_eva.caps.dsa && framebuffer->ncolors > 0) {
+        glNamedFramebufferDrawBuffers(framebuffer->id, framebuffer->ncolors, draw_buffers);
+    } else if (_eva.caps.dsa) {
+        glNamedFramebufferDrawBuffer(framebuffer->id, GL_NONE);
+        glNamedFramebufferReadBuffer(framebuffer->id, GL_NONE);
+    } else if (framebuffer->ncolors > 0) {
+        glDrawBuffers(framebuffer->ncolors, draw_buffers);
+    } else {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    if (sized != NULL) {
+        int level = (sized == depth) ? desc->depth.level : desc->colors[framebuffer->ncolors - 1].level;
+        framebuffer->width = _eva_image_mipmap_size(sized->width, level);
+        framebuffer->height = _eva_image_mipmap_size(sized->height, level);
+    }
+
+    // Completeness is checked once here rather than every time a pass binds the framebuffer
+    unsigned int status = _eva.caps.dsa ? glCheckNamedFramebufferStatus(framebuffer->id, GL_FRAMEBUFFER) : glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "eva: framebuffer is incomplete (0x%04x)\n", status);
+
+    _eva_state_framebuffer(previous);
+    return (eva_framebuffer_t){_eva_slots_id(&_eva.framebuffers, framebuffer)};
+}
+
+int eva_image_format_supported(int format) {
+    if (_eva.initted == 0)
+        eva_setup(NULL);
+
+    switch (format) {
+        case EVA_IMAGEFORMAT_RGBA8:         return 1;
+        case EVA_IMAGEFORMAT_RGB8:          return 1;
+        case EVA_IMAGEFORMAT_BC1:           return _eva.caps.texture_s3tc;
+        case EVA_IMAGEFORMAT_BC3:           return _eva.caps.texture_s3tc;
+        case EVA_IMAGEFORMAT_BC4:           return 1;
+        case EVA_IMAGEFORMAT_BC5:           return 1;
+        case EVA_IMAGEFORMAT_BC7:           return _eva.caps.texture_bptc;
+        case EVA_IMAGEFORMAT_ETC2_RGB8:     return _eva.caps.texture_etc2;
+        case EVA_IMAGEFORMAT_ETC2_RGBA8:    return _eva.caps.texture_etc2;
+        case EVA_IMAGEFORMAT_RGBA16F:       return 1;
+        case EVA_IMAGEFORMAT_DEPTH:         return 1;
+        case EVA_IMAGEFORMAT_DEPTH_STENCIL: return 1;
+    }
+    return 0;
+}
+
+static int _eva_file_map(char const *path, _eva_file_map_t *map) {
+#if defined(_WIN32)
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(map->file, &size);
+    map->size = (size_t)size.QuadPart;
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    map->data = (map->mapping != NULL) ? MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (map->data == NULL) {
+        if (map->mapping != NULL)
+            CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return 0;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return 0;
+
+    map->data = data;
+    map->size = st.st_size;
+#endif
+    return 1;
+}
+
+static void _eva_file_unmap(_eva_file_map_t *map) {
+#if defined(_WIN32)
+    UnmapViewOfFile(map->data);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap((void *)map->data, map->size);
+#endif
+}
+
+static unsigned int _eva_read_u32(unsigned char const *ptr) {
+    return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((unsigned int)ptr[3] << 24);
+}
+
+static unsigned long long _eva_read_u64(unsigned char const *ptr) {
+    return _eva_read_u32(ptr) | ((unsigned long long)_eva_read_u32(ptr + 4) << 32);
+}
+
+// Only UNORM codes are accepted; there are no sRGB formats to decode the others into. BC1_RGB (131) is left out
+// too, since EVA_IMAGEFORMAT_BC1 samples the punch-through alpha that the RGB variant ignores
+static int _eva_image_format_from_vk(unsigned int vk_format) {
+    switch (vk_format) {
+        case 37:            return EVA_IMAGEFORMAT_RGBA8;
+        case 133:           return EVA_IMAGEFORMAT_BC1;
+        case 137:           return EVA_IMAGEFORMAT_BC3;
+        case 139:           return EVA_IMAGEFORMAT_BC4;
+        case 141:           return EVA_IMAGEFORMAT_BC5;
+        case 145:           return EVA_IMAGEFORMAT_BC7;
+        case 147:           return EVA_IMAGEFORMAT_ETC2_RGB8;
+        case 151:           return EVA_IMAGEFORMAT_ETC2_RGBA8;
+    }
+    return -1;
+}
+
+static int _eva_image_format_from_dxgi(unsigned int dxgi_format) {
+    switch (dxgi_format) {
+        case 28:            return EVA_IMAGEFORMAT_RGBA8;
+        case 71:            return EVA_IMAGEFORMAT_BC1;
+        case 77:            return EVA_IMAGEFORMAT_BC3;
+        case 80:            return EVA_IMAGEFORMAT_BC4;
+        case 83:            return EVA_IMAGEFORMAT_BC5;
+        case 98:            return EVA_IMAGEFORMAT_BC7;
+    }
+    return -1;
+}
+
+static int _eva_image_format_from_fourcc(unsigned char const *fourcc) {
+    if (memcmp(fourcc, "DXT1", 4) == 0) return EVA_IMAGEFORMAT_BC1;
+    if (memcmp(fourcc, "DXT5", 4) == 0) return EVA_IMAGEFORMAT_BC3;
+    if (memcmp(fourcc, "ATI1", 4) == 0) return EVA_IMAGEFORMAT_BC4;
+    if (memcmp(fourcc, "BC4U", 4) == 0) return EVA_IMAGEFORMAT_BC4;
+    if (memcmp(fourcc, "ATI2", 4) == 0) return EVA_IMAGEFORMAT_BC5;
+    if (memcmp(fourcc, "BC5U", 4) == 0) return EVA_IMAGEFORMAT_BC5;
+    return -1;
+}
+
+static int _eva_image_parse_ktx2(_eva_file_map_t *map, eva_image_desc_t *desc) {
+    static unsigned char const identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    unsigned char const *header = map->data + 12;
+
+    if (map->size < 80 || memcmp(map->data, identifier, sizeof identifier) != 0)
+        return 0;
+
+    unsigned int width = _eva_read_u32(header + 8);
+    unsigned int height = _eva_read_u32(header + 12);
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX)
+        return 0;
+
+    desc->format = _eva_image_format_from_vk(_eva_read_u32(header + 0));
+    desc->width  = (int)width;
+    desc->height = (int)height;
+
+    unsigned int depth = _eva_read_u32(header + 16);
+    unsigned int layers = _eva_read_u32(header + 20);
+    unsigned int faces = _eva_read_u32(header + 24);
+    unsigned int levels = _eva_read_u32(header + 28);
+    unsigned int supercompression = _eva_read_u32(header + 32);
+
+    if (desc->format < 0 || depth > 1 || layers > 1 || faces != 1 || supercompression != 0 || levels > EVA_IMAGE_MAX_MIPMAPS)
+        return 0;
+
+    // A level count of 0 asks the loader to build the chain itself, so only the base level is stored
+    int stored = (levels > 0) ? (int)levels : 1;
+    desc->mipmaps.count = (int)levels;
+    desc->mipmaps.generate = (levels == 0);
+
+    _eva_image_t info = {0};
+    _eva_image_describe(&info, desc);
+
+    size_t index = 80;
+    if (map->size < index + stored * 24)
+        return 0;
+
+    for (int level = 0; level < stored; level++) {
+        unsigned long long offset = _eva_read_u64(map->data + index + level * 24);
+        unsigned long long length = _eva_read_u64(map->data + index + level * 24 + 8);
+        if (offset > map->size || length > map->size - offset || length < _eva_image_mipmap_bytes(&info, level))
+            return 0;
+        desc->mipmaps.data[level] = map->data + offset;
+    }
+
+    return 1;
+}
+
+static int _eva_image_parse_dds(_eva_file_map_t *map, eva_image_desc_t *desc) {
+    if (map->size < 128 || memcmp(map->data, "DDS ", 4) != 0)
+        return 0;
+
+    unsigned char const *header = map->data + 4;
+    unsigned char const *pixel_format = header + 72;
+    size_t offset = 128;
+
+    unsigned int height = _eva_read_u32(header + 8);
+    unsigned int width = _eva_read_u32(header + 12);
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX)
+        return 0;
+
+    desc->width  = (int)width;
+    desc->height = (int)height;
+
+    unsigned int levels = _eva_read_u32(header + 24);
+    unsigned int flags = _eva_read_u32(pixel_format + 4);
+
+    // Cubemaps and volumes aren't 2D images, and their extra faces or slices would be read as mip levels
+    if (_eva_read_u32(header + 108) & (0x200 | 0x200000))
+        return 0;
+
+    if (flags & 0x4) {
+        if (memcmp(pixel_format + 8, "DX10", 4) == 0) {
+            unsigned char const *dx10 = map->data + 128;
+            if (map->size < 148 || _eva_read_u32(dx10 + 4) != 3 || (_eva_read_u32(dx10 + 8) & 0x4) || _eva_read_u32(dx10 + 12) > 1)
+                return 0;
+            desc->format = _eva_image_format_from_dxgi(_eva_read_u32(dx10));
+            offset = 148;
+        } else {
+            desc->format = _eva_image_format_from_fourcc(pixel_format + 8);
+        }
+    } else if ((flags & 0x40) && _eva_read_u32(pixel_format + 12) == 32 && _eva_read_u32(pixel_format + 16) == 0x000000ff) {
+        desc->format = EVA_IMAGEFORMAT_RGBA8;
+    } else {
+        desc->format = -1;
+    }
+
+    if (desc->format < 0 || levels > EVA_IMAGE_MAX_MIPMAPS)
+        return 0;
+
+    desc->mipmaps.count = (levels > 0) ? levels : 1;
+    desc->mipmaps.generate = 0;
+
+    _eva_image_t info = {0};
+    _eva_image_describe(&info, desc);
+
+    for (int level = 0; level < desc->mipmaps.count; level++) {
+        size_t size = _eva_image_mipmap_bytes(&info, level);
+        if (size > map->size - offset)
+            return 0;
+        desc->mipmaps.data[level] = map->data + offset;
+        offset += size;
+    }
+
+    return 1;
+}
+
+eva_image_t eva_image_load_file(char const *path, eva_image_desc_t *desc) {
+    _eva_file_map_t map = {0};
+    if (!_eva_file_map(path, &map)) {
+        fprintf(stderr, "eva: could not map '%s'\n", path);
+        return (eva_image_t){0};
+    }
+
+    // Only sampling state comes from the caller; everything describing the pixels comes from the container
+    eva_image_desc_t file_desc = {
+        .wrap   = desc->wrap,
+        .filter = desc->filter,
+        .async  = desc->async,
+    };
+
+    eva_image_t image = {0};
+    if (_eva_image_parse_ktx2(&map, &file_desc) || _eva_image_parse_dds(&map, &file_desc)) {
+        if (eva_image_format_supported(file_desc.format))
+            image = eva_image_create(&file_desc);
+        else
+            fprintf(stderr, "eva: '%s' uses an unsupported format\n", path);
+    } else {
+        fprintf(stderr, "eva: '%s' is not a valid KTX2 or DDS image\n", path);
+    }
+
+    _eva_file_unmap(&map);
+    return image;
+}
+
+static void _eva_image_make_non_resident(int index) {
+    _eva_image_t *image = _eva.resident.images[index];
+    _eva.bindless.make_non_resident(image->handle);
+    _eva.resident.bytes -= image->bytes;
+    image->resident = 0;
+
+    _eva_resident_remove(image);
+    _eva.resident.images[index] = _eva.resident.images[--_eva.resident.count];
+}
+
+static void _eva_image_make_resident(_eva_image_t *image) {
+    // Evict the least recently used handles, but never one the current pass may already reference
+    while (_eva.resident.bytes + image->bytes > EVA_IMAGE_RESIDENT_BUDGET) {
+        int oldest = -1;
+        for (int i = 0; i < _eva.resident.count; i++)
+            if (_eva.resident.images[i]->last_used != _eva.resident.epoch &&
+                (oldest < 0 || _eva.resident.images[i]->last_used < _eva.resident.images[oldest]->last_used))
+                oldest = i;
+
+        if (oldest < 0)
+            break;
+        _eva_image_make_non_resident(oldest);
+    }
+
+    if (_eva.resident.count == _eva.resident.capacity) {
+        _eva.resident.capacity = (_eva.resident.capacity != 0) ? _eva.resident.capacity * 2 : 64;
+        _eva.resident.images = realloc(_eva.resident.images, _eva.resident.capacity * sizeof *_eva.resident.images);
+
+        free(_eva.resident.table);
+        _eva.resident.table = calloc(_eva.resident.capacity * 2, sizeof *_eva.resident.table);
+        for (int i = 0; i < _eva.resident.count; i++)
+            _eva_resident_insert(_eva.resident.images[i]);
+    }
+
+    _eva.bindless.make_resident(image->handle);
+    _eva_resident_insert(image);
+    _eva.resident.images[_eva.resident.count++] = image;
+    _eva.resident.bytes += image->bytes;
+    image->resident = 1;
+}
+
+unsigned long long eva_image_handle(eva_image_t handle) {
+    _eva_image_t *image = _eva_slots_get(&_eva.images, handle.id);
+    if (image == NULL) {
+        fprintf(stderr, "eva: image was deleted\n");
+        return 0;
+    }
+
+    if (!_eva.caps.bindless || image->target == GL_RENDERBUFFER)
+        return 0;
+
+    if (image->handle == 0) {
+        for (int level = 0; level < image->mipmaps; level++)
+            image->bytes += _eva_image_mipmap_bytes(image, level);
+        image->handle = _eva.bindless.get_handle(image->id);
+    }
+
+    if (!image->resident)
+        _eva_image_make_resident(image);
+
+    image->last_used = _eva.resident.epoch;
+    return image->handle;
+}
+
+int eva_image_ready(eva_image_t handle) {
+    _eva_image_t *image = _eva_slots_get(&_eva.images, handle.id);
+    if (image == NULL) {
+        fprintf(stderr, "eva: image was deleted\n");
+        return 0;
+    }
+
+    if (image->upload == NULL)
+        return 1;
+
+    if (!_eva_fence_signaled(image->upload, 0))
+        return 0;
+
+    glDeleteSync(image->upload);
+    image->upload = NULL;
+    return 1;
+}
+
+void eva_buffer_delete(eva_buffer_t handle) {
+    _eva_buffer_t *buffer = _eva_slots_get(&_eva.buffers, handle.id);
+    if (buffer == NULL) {
+        fprintf(stderr, "eva: buffer was already deleted\n");
+        return;
+    }
+
+    _eva_vao_evict(buffer);
+    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS; i++)
+        if (_eva.bindings.vbos[i] == buffer)
+            _eva.bindings.vbos[i] = NULL;
+    if (_eva.bindings.ibo == buffer)
+        _eva.bindings.ibo = NULL;
+    if (_eva.state.array_buffer == buffer->id)
+        _eva.state.array_buffer = 0;
+    if (_eva.state.indirect_buffer == buffer->id)
+        _eva.state.indirect_buffer = 0;
+
+    for (int i = 0; i < EVA_BUFFER_STREAM_REGIONS; i++)
+        if (buffer->stream.fences[i] != NULL)
+            glDeleteSync(buffer->stream.fences[i]);
+
+    glDeleteBuffers(1, &buffer->id);
+    _eva_slots_free(&_eva.buffers, buffer);
+}
+
+void eva_pool_delete(eva_pool_t *pool) {
+    eva_buffer_delete(pool->vbo);
+    if (pool->ibo.id != 0)
+        eva_buffer_delete(pool->ibo);
+
+    _eva_buddy_destroy(&pool->vertices);
+    _eva_buddy_destroy(&pool->indices);
+    free(pool->meshes);
+    free(pool);
+}
+
+void eva_shader_delete(eva_shader_t handle) {
+    _eva_shader_t *shader = _eva_slots_get(&_eva.shaders, handle.id);
+    if (shader == NULL) {
+        fprintf(stderr, "eva: shader was already deleted\n");
+        return;
+    }
+
+    if (_eva.shader == shader)
+        _eva.shader = NULL;
+
+    if (shader->pending != NULL) {
+        glDeleteShader(shader->pending->stages[0]);
+        glDeleteShader(shader->pending->stages[1]);
+        free(shader->pending);
+    }
+
+    _eva_block_t *block = &_eva.blocks[shader->block.binding];
+    if (shader->block.size != 0 && --block->refs == 0) {
+        if (_eva.state.uniform_buffers[shader->block.binding] == block->id)
+            _eva.state.uniform_buffers[shader->block.binding] = 0;
+        glDeleteBuffers(1, &block->id);
+        free(block->data);
+        *block = (_eva_block_t){0};
+    }
+
+    glDeleteProgram(shader->id);
+    _eva_slots_free(&_eva.shaders, shader);
+}
+
+void eva_image_delete(eva_image_t handle) {
+    _eva_image_t *image = _eva_slots_get(&_eva.images, handle.id);
+    if (image == NULL) {
+        fprintf(stderr, "eva: image was already deleted\n");
+        return;
+    }
+
+    for (int i = 0; i < EVA_BINDINGS_MAX_IMAGES; i++) {
+        if (_eva.bindings.images[i] == image)
+            _eva.bindings.images[i] = NULL;
+        if (_eva.state.textures[i] == image->id)
+            _eva.state.textures[i] = 0;
+    }
+
+    if (image->upload != NULL)
+        glDeleteSync(image->upload);
+
+    for (int i = 0; i < _eva.resident.count; i++)
+        if (_eva.resident.images[i] == image)
+            _eva_image_make_non_resident(i);
+
+    if (image->target == GL_RENDERBUFFER)
+        glDeleteRenderbuffers(1, &image->id);
+    else
+        glDeleteTextures(1, &image->id);
+    _eva_slots_free(&_eva.images, image);
+}
+
+void eva_framebuffer_delete(eva_framebuffer_t handle) {
+    _eva_framebuffer_t *framebuffer = _eva_slots_get(&_eva.framebuffers, handle.id);
+    if (framebuffer == NULL) {
+        fprintf(stderr, "eva: framebuffer was already deleted\n");
+        return;
+    }
+
+    if (_eva.framebuffer == framebuffer)
+        _eva.framebuffer = NULL;
+    if (_eva.resolve == framebuffer)
+        _eva.resolve = NULL;
+    if (_eva.state.framebuffer == framebuffer->id)
+        _eva.state.framebuffer = 0;
+    glDeleteFramebuffers(1, &framebuffer->id);
+    _eva_slots_free(&_eva.framebuffers, framebuffer);
+}
+
+void eva_pass_begin(eva_pass_desc_t *desc) {
+    _eva.resident.epoch++;
+    _eva.pass = *desc;
+    _eva.framebuffer = _eva_slots_get(&_eva.framebuffers, desc->framebuffer.id);
+    _eva.resolve = _eva_slots_get(&_eva.framebuffers, desc->resolve.id);
+
+    // Ending a pass that never began has nothing to resolve or invalidate
+    if ((desc->framebuffer.id != 0 && _eva.framebuffer == NULL) || (desc->resolve.id != 0 && _eva.resolve == NULL)) {
+        fprintf(stderr, "eva: pass references a deleted framebuffer\n");
+        _eva.pass = (eva_pass_desc_t){0};
+        _eva.framebuffer = _eva.resolve = NULL;
+        return;
+    }
+
+    // Without a target there is nothing to resolve into, so keep the contents rather than invalidating them
+    if (_eva.resolve == NULL || _eva.framebuffer == NULL) {
+        int warned = 0;
+        for (int i = 0; i < EVA_FRAMEBUFFER_MAX_COLORS + 2; i++) {
+            int *action = (i < EVA_FRAMEBUFFER_MAX_COLORS) ? &_eva.pass.store.colors[i]
+                        : (i == EVA_FRAMEBUFFER_MAX_COLORS) ? &_eva.pass.store.depth : &_eva.pass.store.stencil;
+            if (*action != EVA_STOREACTION_RESOLVE)
+                continue;
+            if (!warned++)
+                fprintf(stderr, "eva: resolve store action without a resolve framebuffer, storing instead\n");
+            *action = EVA_STOREACTION_STORE;
+        }
+    }
+
+    _eva_framebuffer_t *framebuffer = _eva.framebuffer;
+    _eva_state_framebuffer((framebuffer != NULL) ? framebuffer->id : 0);
+
+    int w = desc->viewport.w, h = desc->viewport.h;
+    if (framebuffer != NULL && w == 0 && h == 0) {
+        w = framebuffer->width;
+        h = framebuffer->height;
+    }
+    _eva_state_viewport(desc->viewport.x, desc->viewport.y, w, h);
+
+    // The default framebuffer names its buffers differently from attachments of a framebuffer object
+    int ncolors = (framebuffer != NULL) ? framebuffer->ncolors : 1;
+    int depth = (framebuffer != NULL) ? framebuffer->depth : 1;
+    int stencil = (framebuffer != NULL) ? framebuffer->stencil : 1;
+
+    unsigned int invalidate[EVA_FRAMEBUFFER_MAX_COLORS + 2];
+    int ninvalidate = 0;
+    int nclears = 0;
+    unsigned int mask = 0;
+
+    for (int i = 0; i < ncolors; i++) {
+        if (desc->load.colors[i] == EVA_LOADACTION_CLEAR)
+            nclears++;
+        else if (desc->load.colors[i] == EVA_LOADACTION_DONTCARE)
+            invalidate[ninvalidate++] = (framebuffer != NULL) ? GL_COLOR_ATTACHMENT0 + i : GL_COLOR;
+    }
+
+    // Clears are masked like any other write, so whatever the last pipeline disabled has to be turned back on
+    if (nclears > 0)
+        _eva_state_color_mask(EVA_COLORMASK_RGBA);
+
+    if (nclears == ncolors) {
+        _eva_state_clear_color(desc->clear.r, desc->clear.g, desc->clear.b, desc->clear.a);
+        mask |= GL_COLOR_BUFFER_BIT;
+    } else {
+        for (int i = 0; i < ncolors; i++)
+            if (desc->load.colors[i] == EVA_LOADACTION_CLEAR)
+                glClearBufferfv(GL_COLOR, i, &desc->clear.r);
+    }
+
+    if (depth && desc->load.depth == EVA_LOADACTION_CLEAR) {
+        _eva_state_depth_mask(1);
+        mask |= GL_DEPTH_BUFFER_BIT;
+    } else if (depth && desc->load.depth == EVA_LOADACTION_DONTCARE)
+        invalidate[ninvalidate++] = (framebuffer != NULL) ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+
+    if (stencil && desc->load.stencil == EVA_LOADACTION_CLEAR) {
+        _eva_state_stencil_mask(0, 0xFFFFFFFF);
+        mask |= GL_STENCIL_BUFFER_BIT;
+    } else if (stencil && desc->load.stencil == EVA_LOADACTION_DONTCARE)
+        invalidate[ninvalidate++] = (framebuffer != NULL) ? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+
+    if (ninvalidate > 0 && _eva.caps.invalidate_framebuffer)
+        glInvalidateFramebuffer(GL_FRAMEBUFFER, ninvalidate, invalidate);
+
+    if (mask != 0)
+        glClear(mask);
+}
+
+void eva_uniforms_apply(void *data) {
+    _eva_shader_t *shader = _eva.shader;
+    if (shader == NULL) {
+        fprintf(stderr, "eva: no pipeline is applied\n");
+        return;
+    }
+
+    _eva_state_program(shader->id);
+
+    if (shader->block.size != 0) {
+        _eva_shader_block_apply(shader, data);
+        return;
+    }
+
+    for (int i = 0; i < shader->nuniforms; i++) {
+        _eva_uniform_desc_t u = shader->uniforms[i];
+        void *ptr = (char *)data + u.offset;
+
+        switch (u.format) {
+            case EVA_UNIFORMFORMAT_INT:     glUniform1iv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_INT2:    glUniform2iv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_INT3:    glUniform3iv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_INT4:    glUniform4iv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_FLOAT:   glUniform1fv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_FLOAT2:  glUniform2fv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_FLOAT3:  glUniform3fv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_FLOAT4:  glUniform4fv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_MAT3:    glUniformMatrix3fv(u.location, 1, 0, ptr); break;
+            case EVA_UNIFORMFORMAT_MAT4:    glUniformMatrix4fv(u.location, 1, 0, ptr); break;
+            case EVA_UNIFORMFORMAT_IMAGE2D: glUniform1iv(u.location, 1, ptr);          break;
+            case EVA_UNIFORMFORMAT_HANDLE:
+                if (_eva.caps.bindless) {
+                    unsigned long long handle;
+                    memcpy(&handle, ptr, sizeof handle);
+                    _eva_image_touch_handle(handle);
+                    _eva.bindless.uniform_handle(u.location, handle);
+                }
+                break;
+            default:                                                                   break;
+        }
+    }
+}
+
+// Swaps the caller's handles for the resources themselves, failing if any of them has been deleted
+static int _eva_bindings_resolve(eva_bindings_desc_t *bindings, _eva_bindings_t *resolved) {
+    *resolved = (_eva_bindings_t){0};
+    for (int i = 0; i < EVA_BINDINGS_MAX_VBOS && bindings->vbos[i].id != 0; i++)
+        if ((resolved->vbos[i] = _eva_slots_get(&_eva.buffers, bindings->vbos[i].id)) == NULL)
+            return 0;
+    for (int i = 0; i < EVA_BINDINGS_MAX_IMAGES && bindings->images[i].id != 0; i++)
+        if ((resolved->images[i] = _eva_slots_get(&_eva.images, bindings->images[i].id)) == NULL)
+            return 0;
+    resolved->ibo = _eva_slots_get(&_eva.buffers, bindings->ibo.id);
+    return bindings->ibo.id == 0 || resolved->ibo != NULL;
+}
+
+void eva_bindings_apply(eva_bindings_desc_t *desc) {
+    _eva_bindings_t resolved;
+    _eva_bindings_t *bindings = &resolved;
+    if (!_eva_bindings_resolve(desc, bindings)) {
+        fprintf(stderr, "eva: bindings reference a deleted resource\n");
+        return;
+    }
+
+    // Render-only images are renderbuffers, which can't be bound to a texture unit
+    for (int i = 0; i < EVA_BINDINGS_MAX_IMAGES && bindings->images[i] != NULL; i++) {
+        if (bindings->images[i]->target == GL_RENDERBUFFER) {
+            fprintf(stderr, "eva: render-only image can't be bound for sampling\n");
+            return;
+        }
+        if (i >= _eva.caps.max_texture_units) {
+            fprintf(stderr, "eva: image %d is past the %d texture units the context has\n", i, _eva.caps.max_texture_units);
+            return;
+        }
+    }
+
+    _eva_state_vao(_eva_vao_lookup(bindings));
+
+    for (int i = 0; i < EVA_BINDINGS_MAX_IMAGES && bindings->images[i] != NULL; i++)
+        _eva_state_texture(i, bindings->images[i]->target, bindings->images[i]->id);
+
+    _eva.bindings = *bindings;
+}
+
+void eva_pipeline_apply(eva_pipeline_desc_t *desc) {
+    eva_pipeline_desc_t *pipeline = desc;
+    _eva_shader_t *shader = _eva_slots_get(&_eva.shaders, pipeline->shader.id);
+    if (shader == NULL) {
+        fprintf(stderr, "eva: pipeline references a deleted shader\n");
+        return;
+    }
+
+    if (shader->pending != NULL)
+        _eva_shader_finalize(shader);
+
+    _eva_state_program(shader->id);
+
+    // Each piece of fixed-function state is diffed on its own, so pipelines that differ only slightly stay cheap to switch
+    _eva_state_enable(GL_BLEND, &_eva.state.blend.enabled, pipeline->blend.enabled != 0);
+    if (pipeline->blend.enabled) {
+        _eva_state_blend_func(TranslateBlendFactor(pipeline->blend.src_rgb, GL_ONE), TranslateBlendFactor(pipeline->blend.dst_rgb, GL_ZERO),
+                              TranslateBlendFactor(pipeline->blend.src_alpha, GL_ONE), TranslateBlendFactor(pipeline->blend.dst_alpha, GL_ZERO));
+        _eva_state_blend_equation(TranslateBlendOp(pipeline->blend.op_rgb), TranslateBlendOp(pipeline->blend.op_alpha));
+    }
+
+    int color_mask = pipeline->blend.color_mask;
+    _eva_state_color_mask((color_mask == EVA_COLORMASK_DEFAULT) ? EVA_COLORMASK_RGBA : (color_mask & EVA_COLORMASK_RGBA));
+
+    int depth = pipeline->depth.compare != EVA_COMPAREFUNC_ALWAYS || pipeline->depth.write;
+    _eva_state_enable(GL_DEPTH_TEST, &_eva.state.depth.enabled, depth);
+    if (depth) {
+        _eva_state_depth_func(TranslateCompareFunc(pipeline->depth.compare));
+        _eva_state_depth_mask(pipeline->depth.write != 0);
+    }
+
+    _eva_state_enable(GL_STENCIL_TEST, &_eva.state.stencil.enabled, pipeline->stencil.enabled != 0);
+    if (pipeline->stencil.enabled) {
+        unsigned int read_mask = (pipeline->stencil.read_mask != 0) ? pipeline->stencil.read_mask : 0xFFFFFFFF;
+        unsigned int write_mask = pipeline->stencil.write_mask_set ? pipeline->stencil.write_mask : 0xFFFFFFFF;
+
+        for (int face = 0; face < 2; face++) {
+            int compare = (face == 0) ? pipeline->stencil.front.compare : pipeline->stencil.back.compare;
+            int fail = (face == 0) ? pipeline->stencil.front.fail : pipeline->stencil.back.fail;
+            int depth_fail = (face == 0) ? pipeline->stencil.front.depth_fail : pipeline->stencil.back.depth_fail;
+            int pass = (face == 0) ? pipeline->stencil.front.pass : pipeline->stencil.back.pass;
+
+            _eva_state_stencil_func(face, TranslateCompareFunc(compare), pipeline->stencil.ref, read_mask);
+            _eva_state_stencil_op(face, TranslateStencilOp(fail), TranslateStencilOp(depth_fail), TranslateStencilOp(pass));
+            _eva_state_stencil_mask(face, write_mask);
+        }
+    }
+
+    _eva_state_enable(GL_CULL_FACE, &_eva.state.cull.enabled, pipeline->rasterizer.cull != EVA_CULLMODE_NONE);
+    if (pipeline->rasterizer.cull != EVA_CULLMODE_NONE)
+        _eva_state_cull_face((pipeline->rasterizer.cull == EVA_CULLMODE_FRONT) ? GL_FRONT : GL_BACK);
+    _eva_state_front_face((pipeline->rasterizer.front_face == EVA_FACEWINDING_CW) ? GL_CW : GL_CCW);
+
+    int offset = pipeline->rasterizer.offset_factor != 0.0f || pipeline->rasterizer.offset_units != 0.0f;
+    _eva_state_enable(GL_POLYGON_OFFSET_FILL, &_eva.state.offset.enabled, offset);
+    if (offset)
+        _eva_state_polygon_offset(pipeline->rasterizer.offset_factor, pipeline->rasterizer.offset_units);
+
+    _eva.pipeline = *pipeline;
+    _eva.shader = shader;
+}
+
+void eva_draw(int first, int count) {
+    eva_draw_base_vertex(first, count, 0, 0);
+}
+
+void eva_draw_instanced(int first, int count, int instances) {
+    eva_draw_base_vertex(first, count, instances, 0);
+}
+
+// For indexed draws first counts indices and base_vertex is added to each one, which lets meshes share a buffer
+void eva_draw_base_vertex(int first, int count, int instances, int base_vertex) {
+    int primitive = TranslatePrimitiveType(_eva.pipeline.primitive);
+    _eva_buffer_t *ibo = _eva.bindings.ibo;
+
+    if (ibo == NULL) {
+        if (instances > 0)
+            glDrawArraysInstanced(primitive, first + base_vertex, count, instances);
+        else
+            glDrawArrays(primitive, first + base_vertex, count);
+        return;
+    }
+
+    void *offset = (void *)((size_t)first * ibo->index_size);
+    if (instances > 0 && base_vertex != 0)
+        glDrawElementsInstancedBaseVertex(primitive, count, ibo->index_type, offset, instances, base_vertex);
+    else if (instances > 0)
+        glDrawElementsInstanced(primitive, count, ibo->index_type, offset, instances);
+    else if (base_vertex != 0)
+        glDrawElementsBaseVertex(primitive, count, ibo->index_type, offset, base_vertex);
+    else
+        glDrawElements(primitive, count, ibo->index_type, offset);
+}
+
+void eva_draw_indirect(eva_buffer_t handle, size_t offset, int count) {
+    _eva_buffer_t *buffer = _eva_slots_get(&_eva.buffers, handle.id);
+    if (buffer == NULL) {
+        fprintf(stderr, "eva: buffer was deleted\n");
+        return;
+    }
+
+    if (buffer->type != EVA_BUFFERTYPE_INDIRECT) {
+        fprintf(stderr, "eva: eva_draw_indirect needs an EVA_BUFFERTYPE_INDIRECT buffer\n");
+        return;
+    }
+
+    _eva_state_indirect_buffer(buffer->id);
+    int primitive = TranslatePrimitiveType(_eva.pipeline.primitive);
+
+    if (_eva.caps.multi_draw_indirect) {
+        if (_eva.bindings.ibo)
+            glMultiDrawElementsIndirect(primitive, _eva.bindings.ibo->index_type, (void *)offset, count, 0);
+        else
+            glMultiDrawArraysIndirect(primitive, (void *)offset, count, 0);
+        return;
+    }
+
+    if (_eva.caps.draw_indirect) {
+        for (int i = 0; i < count; i++) {
+            if (_eva.bindings.ibo)
+                glDrawElementsIndirect(primitive, _eva.bindings.ibo->index_type, (void *)(offset + i * sizeof(eva_draw_elements_indirect_t)));
+            else
+                glDrawArraysIndirect(primitive, (void *)(offset + i * sizeof(eva_draw_arrays_indirect_t)));
+        }
+        return;
+    }
+
+    fprintf(stderr, "eva: indirect drawing requires OpenGL 4.0\n");
+}
+
+static size_t _eva_cmdbuf_push(eva_cmdbuf_t *cmdbuf, void const *data, size_t size) {
+    size_t offset = (cmdbuf->arena_used + 15) & ~(size_t)15;
+    if (offset + size > cmdbuf->arena_size) {
+        while (offset + size > cmdbuf->arena_size)
+            cmdbuf->arena_size *= 2;
+        cmdbuf->arena = realloc(cmdbuf->arena, cmdbuf->arena_size);
+    }
+
+    memcpy(cmdbuf->arena + offset, data, size);
+    cmdbuf->arena_used = offset + size;
+    return offset;
+}
+
+// Records are only pushed when they differ from the current one, so equal offsets mean equal state
+static size_t _eva_cmdbuf_push_state(eva_cmdbuf_t *cmdbuf, size_t current, void const *data, size_t size) {
+    if (current != _EVA_CMD_NONE && memcmp(cmdbuf->arena + current, data, size) == 0)
+        return current;
+    return _eva_cmdbuf_push(cmdbuf, data, size);
+}
+
+static unsigned int _eva_hash_bytes(void const *data, size_t size) {
+    unsigned char const *bytes = data;
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash ^ (hash >> 16);
+}
+
+static unsigned long long _eva_cmdbuf_key(eva_cmdbuf_t *cmdbuf, float depth) {
+    eva_pipeline_desc_t *pipeline = (eva_pipeline_desc_t *)(cmdbuf->arena + cmdbuf->pipeline);
+    eva_bindings_desc_t *bindings = (eva_bindings_desc_t *)(cmdbuf->arena + cmdbuf->bindings);
+
+    depth = (depth < 0.f) ? 0.f : (depth > 1.f) ? 1.f : depth;
+
+    // Pass, shader, pipeline state, textures, vertex buffers, then depth, so the most expensive changes are the rarest.
+    // Only handle bits go in, since workers record while the GL thread creates and deletes resources
+    unsigned long long key = 0;
+    key |= (unsigned long long)((cmdbuf->npasses > 0) ? cmdbuf->npasses - 1 : 0) << 56;
+    key |= (unsigned long long)(pipeline->shader.id & 0xfff) << 44;
+    key |= (unsigned long long)(_eva_hash_bytes(pipeline, sizeof *pipeline) & 0xff) << 36;
+    key |= (unsigned long long)(_eva_hash_bytes(bindings->images, sizeof bindings->images) & 0xff) << 28;
+    key |= (unsigned long long)(_eva_hash_bytes(bindings, offsetof(eva_bindings_desc_t, images)) & 0xff) << 20;
+    key |= (unsigned long long)(depth * 0xfffff);
+    return key;
+}
+
+static _eva_cmd_sort_t *_eva_cmd_sort(_eva_cmd_sort_t *src, _eva_cmd_sort_t *dst, int n) {
+    unsigned long long differ = 0;
+    for (int i = 0; i < n; i++)
+        differ |= src[i].key ^ src[0].key;
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differ >> shift) & 0xff) == 0)
+            continue;
+
+        int counts[256] = {0};
+        for (int i = 0; i < n; i++)
+            counts[(src[i].key >> shift) & 0xff]++;
+
+        for (int i = 0, total = 0; i < 256; i++) {
+            int count = counts[i];
+            counts[i] = total;
+            total += count;
+        }
+
+        for (int i = 0; i < n; i++)
+            dst[counts[(src[i].key >> shift) & 0xff]++] = src[i];
+
+        _eva_cmd_sort_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    return src;
+}
+
+// Replays order[begin, end) until the pass changes; returns the index it stopped at
+static int _eva_cmd_replay(eva_cmdbuf_t **sources, _eva_cmd_sort_t *order, int begin, int end, int pass) {
+    eva_cmdbuf_t *cmdbuf = NULL;
+    size_t bindings = _EVA_CMD_NONE;
+    size_t pipeline = _EVA_CMD_NONE;
+    size_t uniforms = _EVA_CMD_NONE;
+
+    int next = begin;
+    for (; next < end && (int)(order[next].key >> 56) == pass; next++) {
+        // Arena offsets are only comparable within one command buffer
+        if (sources[order[next].source] != cmdbuf) {
+            cmdbuf = sources[order[next].source];
+            bindings = pipeline = uniforms = _EVA_CMD_NONE;
+        }
+
+        _eva_cmd_draw_t *draw = &cmdbuf->draws[order[next].index];
+
+        if (draw->bindings != bindings) {
+            eva_bindings_apply((eva_bindings_desc_t *)(cmdbuf->arena + draw->bindings));
+            bindings = draw->bindings;
+        }
+
+        if (draw->pipeline != pipeline) {
+            eva_pipeline_apply((eva_pipeline_desc_t *)(cmdbuf->arena + draw->pipeline));
+            pipeline = draw->pipeline;
+            uniforms = _EVA_CMD_NONE;
+        }
+
+        if (draw->uniforms != uniforms && draw->uniforms != _EVA_CMD_NONE) {
+            if (_eva.shader != NULL && draw->uniforms_size < _eva.shader->uniforms_size)
+                fprintf(stderr, "eva: recorded %zu bytes of uniforms, the shader needs %zu\n", draw->uniforms_size, _eva.shader->uniforms_size);
+            else
+                eva_uniforms_apply(cmdbuf->arena + draw->uniforms);
+            uniforms = draw->uniforms;
+        }
+
+        eva_draw_base_vertex(draw->first, draw->count, draw->instances, draw->base_vertex);
+    }
+
+    return next;
+}
+
+eva_cmdbuf_t *eva_cmdbuf_create(eva_cmdbuf_desc_t *desc) {
+    eva_cmdbuf_t *cmdbuf = calloc(1, sizeof *cmdbuf);
+    cmdbuf->arena_size = (desc->arena_size != 0) ? desc->arena_size : 64 * 1024;
+    cmdbuf->max_draws = (desc->max_draws != 0) ? desc->max_draws : 1024;
+    cmdbuf->arena = malloc(cmdbuf->arena_size);
+    cmdbuf->draws = malloc(cmdbuf->max_draws * sizeof *cmdbuf->draws);
+    cmdbuf->sort[0] = malloc(cmdbuf->max_draws * sizeof *cmdbuf->sort[0]);
+    cmdbuf->sort[1] = malloc(cmdbuf->max_draws * sizeof *cmdbuf->sort[1]);
+    eva_cmdbuf_reset(cmdbuf);
+    return cmdbuf;
+}
+
+void eva_cmdbuf_pass_begin(eva_cmdbuf_t *cmdbuf, eva_pass_desc_t *pass) {
+    if (cmdbuf->npasses == EVA_CMDBUF_MAX_PASSES) {
+        fprintf(stderr, "eva: command buffer exceeded %d passes\n", EVA_CMDBUF_MAX_PASSES);
+        return;
+    }
+
+    cmdbuf->passes[cmdbuf->npasses++] = _eva_cmdbuf_push(cmdbuf, pass, sizeof *pass);
+}
+
+void eva_cmdbuf_bindings(eva_cmdbuf_t *cmdbuf, eva_bindings_desc_t *bindings) {
+    cmdbuf->bindings = _eva_cmdbuf_push_state(cmdbuf, cmdbuf->bindings, bindings, sizeof *bindings);
+}
+
+void eva_cmdbuf_pipeline(eva_cmdbuf_t *cmdbuf, eva_pipeline_desc_t *pipeline) {
+    size_t previous = cmdbuf->pipeline;
+    cmdbuf->pipeline = _eva_cmdbuf_push_state(cmdbuf, cmdbuf->pipeline, pipeline, sizeof *pipeline);
+
+    // Uniform data is laid out per shader, so it cannot carry over to a different pipeline
+    if (cmdbuf->pipeline != previous)
+        cmdbuf->uniforms = _EVA_CMD_NONE;
+}
+
+// The caller passes the size because the shader, which knows it, is only resolved at replay on the GL thread
+void eva_cmdbuf_uniforms(eva_cmdbuf_t *cmdbuf, void const *data, size_t size) {
+    if (cmdbuf->pipeline == _EVA_CMD_NONE) {
+        fprintf(stderr, "eva: uniforms recorded without a pipeline\n");
+        return;
+    }
+
+    cmdbuf->uniforms = _eva_cmdbuf_push(cmdbuf, data, size);
+    cmdbuf->uniforms_size = size;
+}
+
+void eva_cmdbuf_draw(eva_cmdbuf_t *cmdbuf, int first, int count, float depth) {
+    eva_cmdbuf_draw_instanced(cmdbuf, first, count, 0, depth);
+}
+
+void eva_cmdbuf_draw_instanced(eva_cmdbuf_t *cmdbuf, int first, int count, int instances, float depth) {
+    eva_cmdbuf_draw_base_vertex(cmdbuf, first, count, instances, 0, depth);
+}
+
+void eva_cmdbuf_draw_base_vertex(eva_cmdbuf_t *cmdbuf, int first, int count, int instances, int base_vertex, float depth) {
+    if (cmdbuf->bindings == _EVA_CMD_NONE || cmdbuf->pipeline == _EVA_CMD_NONE) {
+        fprintf(stderr, "eva: draw recorded without bindings and a pipeline\n");
+        return;
+    }
+
+    if (cmdbuf->ndraws == cmdbuf->max_draws) {
+        cmdbuf->max_draws *= 2;
+        cmdbuf->draws = realloc(cmdbuf->draws, cmdbuf->max_draws * sizeof *cmdbuf->draws);
+        cmdbuf->sort[0] = realloc(cmdbuf->sort[0], cmdbuf->max_draws * sizeof *cmdbuf->sort[0]);
+        cmdbuf->sort[1] = realloc(cmdbuf->sort[1], cmdbuf->max_draws * sizeof *cmdbuf->sort[1]);
+    }
+
+    cmdbuf->draws[cmdbuf->ndraws++] = (_eva_cmd_draw_t){
+        .key           = _eva_cmdbuf_key(cmdbuf, depth),
+        .bindings      = cmdbuf->bindings,
+        .pipeline      = cmdbuf->pipeline,
+        .uniforms      = cmdbuf->uniforms,
+        .uniforms_size = cmdbuf->uniforms_size,
+        .first         = first,
+        .count         = count,
+        .instances     = instances,
+        .base_vertex   = base_vertex,
+    };
+}
+
+void eva_cmdbuf_submit(eva_cmdbuf_t *cmdbuf) {
+    for (int i = 0; i < cmdbuf->ndraws; i++)
+        cmdbuf->sort[0][i] = (_eva_cmd_sort_t){.key = cmdbuf->draws[i].key, .index = i};
+
+    _eva_cmd_sort_t *order = _eva_cmd_sort(cmdbuf->sort[0], cmdbuf->sort[1], cmdbuf->ndraws);
+
+    // Without passes the draws go into whichever pass is currently open
+    if (cmdbuf->npasses == 0) {
+        _eva_cmd_replay(&cmdbuf, order, 0, cmdbuf->ndraws, 0);
+        return;
+    }
+
+    int next = 0;
+    for (int pass = 0; pass < cmdbuf->npasses; pass++) {
+        eva_pass_begin((eva_pass_desc_t *)(cmdbuf->arena + cmdbuf->passes[pass]));
+        next = _eva_cmd_replay(&cmdbuf, order, next, cmdbuf->ndraws, pass);
+        eva_pass_end();
+    }
+}
+
+void eva_cmdbuf_reset(eva_cmdbuf_t *cmdbuf) {
+    cmdbuf->arena_used = 0;
+    cmdbuf->ndraws = 0;
+    cmdbuf->npasses = 0;
+    cmdbuf->bindings = _EVA_CMD_NONE;
+    cmdbuf->pipeline = _EVA_CMD_NONE;
+    cmdbuf->uniforms = _EVA_CMD_NONE;
+}
+
+void eva_cmdbuf_delete(eva_cmdbuf_t *cmdbuf) {
+    free(cmdbuf->sort[1]);
+    free(cmdbuf->sort[0]);
+    free(cmdbuf->draws);
+    free(cmdbuf->arena);
+    free(cmdbuf);
+}
+
+void eva_pass_submit(eva_cmdbuf_t *cmdbuf) {
+    if (cmdbuf->npasses != 0) {
+        fprintf(stderr, "eva: command buffers with their own passes must go through eva_cmdbuf_submit\n");
+        return;
+    }
+
+    if (_eva.queue.count == EVA_PASS_MAX_CMDBUFS) {
+        fprintf(stderr, "eva: pass exceeded %d command buffers\n", EVA_PASS_MAX_CMDBUFS);
+        return;
+    }
+
+    _eva.queue.cmdbufs[_eva.queue.count++] = cmdbuf;
+}
+
+static void _eva_queue_flush(void) {
+    int total = 0;
+    for (int i = 0; i < _eva.queue.count; i++)
+        total += _eva.queue.cmdbufs[i]->ndraws;
+
+    if (total > _eva.queue.capacity) {
+        _eva.queue.capacity = total;
+        _eva.queue.sort[0] = realloc(_eva.queue.sort[0], total * sizeof *_eva.queue.sort[0]);
+        _eva.queue.sort[1] = realloc(_eva.queue.sort[1], total * sizeof *_eva.queue.sort[1]);
+    }
+
+    int n = 0;
+    for (int i = 0; i < _eva.queue.count; i++) {
+        eva_cmdbuf_t *cmdbuf = _eva.queue.cmdbufs[i];
+        for (int j = 0; j < cmdbuf->ndraws; j++)
+            _eva.queue.sort[0][n++] = (_eva_cmd_sort_t){.key = cmdbuf->draws[j].key, .index = j, .source = i};
+    }
+
+    _eva_cmd_sort_t *order = _eva_cmd_sort(_eva.queue.sort[0], _eva.queue.sort[1], n);
+    _eva_cmd_replay(_eva.queue.cmdbufs, order, 0, n, 0);
+    _eva.queue.count = 0;
+}
+
+// Multisampled contents are resolved whenever there is somewhere to put them, RESOLVE only adds the discard
+static int _eva_pass_resolves(int action) {
+    return action == EVA_STOREACTION_RESOLVE || (action == EVA_STOREACTION_STORE && _eva.framebuffer->samples > 1);
+}
+
+static void _eva_pass_resolve(eva_pass_desc_t *pass) {
+    _eva_framebuffer_t *src = _eva.framebuffer;
+    _eva_framebuffer_t *dst = _eva.resolve;
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dst->id);
+
+    // Blits write the read buffer into every draw buffer, so route each attachment to its counterpart alone
+    for (int i = 0; i < src->ncolors && i < dst->ncolors; i++) {
+        if (!_eva_pass_resolves(pass->store.colors[i]))
+            continue;
+
+        unsigned int draw_buffers[EVA_FRAMEBUFFER_MAX_COLORS] = {0};
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        glReadBuffer(GL_COLOR_ATTACHMENT0 + i);
+        glDrawBuffers(i + 1, draw_buffers);
+        glBlitFramebuffer(0, 0, src->width, src->height, 0, 0, dst->width, dst->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+    unsigned int mask = 0;
+    if (src->depth && dst->depth && _eva_pass_resolves(pass->store.depth))
+        mask |= GL_DEPTH_BUFFER_BIT;
+    if (src->stencil && dst->stencil && _eva_pass_resolves(pass->store.stencil))
+        mask |= GL_STENCIL_BUFFER_BIT;
+    if (mask != 0)
+        glBlitFramebuffer(0, 0, src->width, src->height, 0, 0, dst->width, dst->height, mask, GL_NEAREST);
+
+    unsigned int draw_buffers[EVA_FRAMEBUFFER_MAX_COLORS];
+    for (int i = 0; i < dst->ncolors; i++)
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    if (dst->ncolors > 0)
+        glDrawBuffers(dst->ncolors, draw_buffers);
+    if (src->ncolors > 0)
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, src->id);
 }
 
 void eva_pass_end(void) {
-    // Does nothing... for now...
+    if (_eva.queue.count > 0)
+        _eva_queue_flush();
+
+    eva_pass_desc_t *pass = &_eva.pass;
+    _eva_framebuffer_t *framebuffer = _eva.framebuffer;
+
+    if (framebuffer != NULL && _eva.resolve != NULL)
+        _eva_pass_resolve(pass);
+
+    // Anything discarded or already resolved is dead, which lets the driver skip writing it back to memory
+    int ncolors = (framebuffer != NULL) ? framebuffer->ncolors : 1;
+    int depth = (framebuffer != NULL) ? framebuffer->depth : 1;
+    int stencil = (framebuffer != NULL) ? framebuffer->stencil : 1;
+
+    unsigned int invalidate[EVA_FRAMEBUFFER_MAX_COLORS + 2];
+    int ninvalidate = 0;
+
+    for (int i = 0; i < ncolors; i++)
+        if (pass->store.colors[i] != EVA_STOREACTION_STORE)
+            invalidate[ninvalidate++] = (framebuffer != NULL) ? GL_COLOR_ATTACHMENT0 + i : GL_COLOR;
+    if (depth && pass->store.depth != EVA_STOREACTION_STORE)
+        invalidate[ninvalidate++] = (framebuffer != NULL) ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+    if (stencil && pass->store.stencil != EVA_STOREACTION_STORE)
+        invalidate[ninvalidate++] = (framebuffer != NULL) ? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+
+    if (ninvalidate > 0 && _eva.caps.invalidate_framebuffer)
+        glInvalidateFramebuffer(GL_FRAMEBUFFER, ninvalidate, invalidate);
+}
+
+eva_stats_t eva_stats(void) {
+    return _eva.stats;
+}
+
+void eva_stats_reset(void) {
+    _eva.stats = (eva_stats_t){0};
 }
 
 #endif // EVA_IMPL